@@ -0,0 +1,101 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "cache_file.h"
+#include "log.h"
+#include "mkdirp.h"
+#include "xmalloc.h"
+
+/* How often to retry a lock that someone else holds. */
+#define CACHE_LOCK_POLL_MS 10
+
+int cache_lock(const char *filename, bool wait)
+{
+	if (!mkdirp(filename)) {
+		return -1;
+	}
+	size_t len = strlen(filename) + 6;
+	char *lock_name = xmalloc(len);
+	snprintf(lock_name, len, "%s.lock", filename);
+
+	errno = 0;
+	int fd = open(lock_name, O_RDONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (fd == -1) {
+		log_error("Failed to open lock file \"%s\": %s\n", lock_name, strerror(errno));
+		free(lock_name);
+		return -1;
+	}
+	free(lock_name);
+
+	/*
+	 * flock() can't time out by itself, so poll instead of blocking.
+	 * This only happens while another process is regenerating.
+	 */
+	const struct timespec interval = {
+		.tv_sec = 0,
+		.tv_nsec = CACHE_LOCK_POLL_MS * 1000000
+	};
+	for (int waited = 0; flock(fd, LOCK_EX | LOCK_NB) == -1; waited += CACHE_LOCK_POLL_MS) {
+		if (errno != EWOULDBLOCK || !wait || waited >= CACHE_LOCK_TIMEOUT_MS) {
+			close(fd);
+			return -1;
+		}
+		nanosleep(&interval, NULL);
+	}
+	return fd;
+}
+
+void cache_unlock(int fd)
+{
+	if (fd != -1) {
+		/* Closing the file releases the lock. */
+		close(fd);
+	}
+}
+
+bool cache_write(const char *filename, const void *data, size_t size)
+{
+	if (!mkdirp(filename)) {
+		return false;
+	}
+	size_t len = strlen(filename) + 8;
+	char *tmp_name = xmalloc(len);
+	snprintf(tmp_name, len, "%s.XXXXXX", filename);
+
+	errno = 0;
+	int fd = mkostemp(tmp_name, O_CLOEXEC);
+	if (fd == -1) {
+		log_error("Failed to create \"%s\": %s\n", tmp_name, strerror(errno));
+		free(tmp_name);
+		return false;
+	}
+
+	const char *buf = data;
+	size_t written = 0;
+	while (written < size) {
+		ssize_t res = write(fd, buf + written, size - written);
+		if (res == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		written += res;
+	}
+	close(fd);
+
+	if (written < size || rename(tmp_name, filename) == -1) {
+		log_error("Failed to write \"%s\": %s\n", filename, strerror(errno));
+		unlink(tmp_name);
+		free(tmp_name);
+		return false;
+	}
+	free(tmp_name);
+	return true;
+}
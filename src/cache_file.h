@@ -0,0 +1,34 @@
+#ifndef CACHE_FILE_H
+#define CACHE_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Helpers for regenerating caches safely when several tofi processes start
+ * at once, e.g. from a script, or with multi-instance set.
+ *
+ * Regeneration is guarded by a lock on a sidecar file next to the cache, so
+ * only one process rebuilds it, and caches are always written to a temporary
+ * file that's renamed into place, so nobody reads one that's half written.
+ */
+
+/* How long to wait for someone else to finish regenerating a cache. */
+#define CACHE_LOCK_TIMEOUT_MS 2000
+
+/*
+ * Lock filename's sidecar file, returning a file descriptor to pass to
+ * cache_unlock(), or -1 if it couldn't be locked. If wait is set, wait up to
+ * CACHE_LOCK_TIMEOUT_MS for the current holder to let go, otherwise return
+ * straight away.
+ */
+int cache_lock(const char *filename, bool wait);
+void cache_unlock(int fd);
+
+/*
+ * Replace the contents of filename with data, creating any directories
+ * needed. Returns false on error, which is logged.
+ */
+bool cache_write(const char *filename, const void *data, size_t size);
+
+#endif /* CACHE_FILE_H */
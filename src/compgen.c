@@ -5,10 +5,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include "cache_file.h"
 #include "compgen.h"
+#include "front_code.h"
 #include "history.h"
 #include "log.h"
-#include "mkdirp.h"
+#include "state_file.h"
 #include "string_vec.h"
 #include "xmalloc.h"
 
@@ -50,22 +53,22 @@ static char *get_cache_path() {
 	return cache_name;
 }
 
+/*
+ * The cache is front coded (see front_code.h), as the sorted list of commands
+ * compresses well that way, which matters when reading it from a slow disk.
+ */
 static void write_cache(const char *buffer, const char *filename)
 {
-	errno = 0;
-	FILE *fp = fopen(filename, "wb");
-	if (!fp) {
-		log_error("Failed to open cache file \"%s\": %s\n", filename, strerror(errno));
-		return;
-	}
-	size_t len = strlen(buffer);
-	errno = 0;
-	if (fwrite(buffer, 1, len, fp) != len) {
-		log_error("Error writing cache file \"%s\": %s\n", filename, strerror(errno));
-	}
-	fclose(fp);
+	size_t len;
+	uint8_t *data = front_code_encode(buffer, &len);
+	cache_write(filename, data, len);
+	free(data);
 }
 
+/*
+ * Returns NULL if the cache can't be read, or is in the wrong format, e.g.
+ * because it was written by an older version of tofi.
+ */
 static char *read_cache(const char *filename)
 {
 	errno = 0;
@@ -89,20 +92,83 @@ static char *read_cache(const char *filename)
 		}
 		size = (size_t)ssize;
 	}
-	char *cache = xmalloc(size + 1);
+	uint8_t *data = xmalloc(size);
 	rewind(fp);
-	if (fread(cache, 1, size, fp) != size) {
+	if (fread(data, 1, size, fp) != size) {
 		log_error("Failed to read cache file: %s\n", strerror(errno));
-		free(cache);
+		free(data);
 		fclose(fp);
 		return NULL;
 	}
 	fclose(fp);
-	cache[size] = '\0';
+
+	char *cache = NULL;
+	struct front_code fc;
+	if (front_code_open(&fc, data, size)) {
+		cache = front_code_decode(&fc);
+	} else {
+		log_debug("Cache isn't front coded.\n");
+	}
+	free(data);
 
 	return cache;
 }
 
+/*
+ * Check whether the cache exists, and is newer than everything in PATH.
+ */
+static bool cache_up_to_date(const char *cache_path, const char *env_path)
+{
+	struct stat sb;
+	if (stat(cache_path, &sb) == -1) {
+		return false;
+	}
+
+	char *path = xstrdup(env_path);
+	char *saveptr = NULL;
+	char *path_entry = strtok_r(path, ":", &saveptr);
+	bool up_to_date = true;
+	while (path_entry != NULL) {
+		struct stat path_sb;
+		if (stat(path_entry, &path_sb) == 0) {
+			if (path_sb.st_mtim.tv_sec > sb.st_mtim.tv_sec) {
+				up_to_date = false;
+				break;
+			}
+		}
+		path_entry = strtok_r(NULL, ":", &saveptr);
+	}
+	free(path);
+	return up_to_date;
+}
+
+/*
+ * A stamp (see state_file.h) of PATH and the modification times of its
+ * directories, which changes whenever a program is installed or removed.
+ */
+uint64_t compgen_stamp(void)
+{
+	const char *env_path = getenv("PATH");
+	if (env_path == NULL) {
+		return 0;
+	}
+
+	uint64_t stamp = 0;
+	char *path = xstrdup(env_path);
+	char *saveptr = NULL;
+	char *path_entry = strtok_r(path, ":", &saveptr);
+	while (path_entry != NULL) {
+		struct stat sb;
+		stamp = state_file_stamp(stamp, path_entry, strlen(path_entry) + 1);
+		if (stat(path_entry, &sb) == 0) {
+			stamp = state_file_stamp(stamp, &sb.st_mtim, sizeof(sb.st_mtim));
+		}
+		path_entry = strtok_r(NULL, ":", &saveptr);
+	}
+	free(path);
+	return stamp;
+}
+
 char *compgen_cached()
 {
 	log_debug("Retrieving PATH.\n");
@@ -114,56 +180,52 @@ char *compgen_cached()
 
 	log_debug("Retrieving cache location.\n");
 	char *cache_path = get_cache_path();
-
-	struct stat sb;
 	if (cache_path == NULL) {
 		return compgen();
 	}
 
-	/* If the cache doesn't exist, create it and return */
-	errno = 0;
-	if (stat(cache_path, &sb) == -1) {
-		if (errno == ENOENT) {
-			char *commands = compgen();
-			if (!mkdirp(cache_path)) {
-				free(cache_path);
-				return commands;
-			}
-			write_cache(commands, cache_path);
+	char *commands = NULL;
+	if (cache_up_to_date(cache_path, env_path)) {
+		log_debug("Cache up to date, loading.\n");
+		commands = read_cache(cache_path);
+		if (commands != NULL) {
+			free(cache_path);
 			return commands;
 		}
-		free(cache_path);
-		return compgen();
+		log_debug("Cache unreadable, updating.\n");
 	}
 
-	/* The cache exists, so check if it's still in date */
-	char *path = xstrdup(env_path);
-	char *saveptr = NULL;
-	char *path_entry = strtok_r(path, ":", &saveptr);
-	bool out_of_date = false;
-	while (path_entry != NULL) {
-		struct stat path_sb;
-		if (stat(path_entry, &path_sb) == 0) {
-			if (path_sb.st_mtim.tv_sec > sb.st_mtim.tv_sec) {
-				out_of_date = true;
-				break;
+	/*
+	 * If another tofi is already regenerating the cache, e.g. because
+	 * lots were started at once after installing something, use the old
+	 * copy if there is one, or otherwise wait for theirs.
+	 */
+	int lock = cache_lock(cache_path, false);
+	if (lock == -1) {
+		if (access(cache_path, R_OK) == 0) {
+			log_debug("Cache being updated elsewhere, using stale copy.\n");
+			commands = read_cache(cache_path);
+		}
+		if (commands == NULL) {
+			log_debug("Cache being updated elsewhere, waiting.\n");
+			lock = cache_lock(cache_path, true);
+			if (cache_up_to_date(cache_path, env_path)) {
+				commands = read_cache(cache_path);
 			}
 		}
-		path_entry = strtok_r(NULL, ":", &saveptr);
+		if (commands != NULL) {
+			cache_unlock(lock);
+			free(cache_path);
+			return commands;
+		}
 	}
-	free(path);
 
-	char *commands;
-	if (out_of_date) {
-		log_debug("Cache out of date, updating.\n");
-		log_indent();
-		commands = compgen();
-		log_unindent();
-		write_cache(commands, cache_path);
-	} else {
-		log_debug("Cache up to date, loading.\n");
-		commands = read_cache(cache_path);
-	}
+	log_debug("Cache missing or out of date, updating.\n");
+	log_indent();
+	commands = compgen();
+	log_unindent();
+	write_cache(commands, cache_path);
+	cache_unlock(lock);
 	free(cache_path);
 	return commands;
 }
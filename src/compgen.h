@@ -1,6 +1,7 @@
 #ifndef COMPGEN_H
 #define COMPGEN_H
 
+#include <stdint.h>
 #include "history.h"
 #include "string_vec.h"
 
@@ -10,6 +11,8 @@ char *compgen(void);
 [[nodiscard("memory leaked")]]
 char *compgen_cached(void);
 
+uint64_t compgen_stamp(void);
+
 [[nodiscard("memory leaked")]]
 struct string_ref_vec compgen_history_sort(struct string_ref_vec *programs, struct history *history);
 
@@ -347,6 +347,8 @@ bool parse_option(struct tofi *tofi, const char *filename, size_t lineno, const
 		snprintf(tofi->window.entry.font_features, N_ELEM(tofi->window.entry.font_features), "%s", value);
 	} else if (strcasecmp(option, "font-variations") == 0) {
 		snprintf(tofi->window.entry.font_variations, N_ELEM(tofi->window.entry.font_variations), "%s", value);
+	} else if (strcasecmp(option, "font-fallback") == 0) {
+		snprintf(tofi->window.entry.font_fallback, N_ELEM(tofi->window.entry.font_fallback), "%s", value);
 	} else if (strcasecmp(option, "num-results") == 0) {
 		uint32_t val = parse_uint32(filename, lineno, value, &err);
 		if (!err) {
@@ -650,6 +652,16 @@ bool parse_option(struct tofi *tofi, const char *filename, size_t lineno, const
 		if (!err) {
 			tofi->fuzzy_match = val;
 		}
+	} else if (strcasecmp(option, "path-match") == 0) {
+		bool val = parse_bool(filename, lineno, value, &err);
+		if (!err) {
+			tofi->path_match = val;
+		}
+	} else if (strcasecmp(option, "sort") == 0) {
+		bool val = parse_bool(filename, lineno, value, &err);
+		if (!err) {
+			tofi->sort_results = val;
+		}
 	} else if (strcasecmp(option, "require-match") == 0) {
 		bool val = parse_bool(filename, lineno, value, &err);
 		if (!err) {
@@ -691,6 +703,11 @@ bool parse_option(struct tofi *tofi, const char *filename, size_t lineno, const
 		if (!err) {
 			tofi->ascii_input = val;
 		}
+	} else if (strcasecmp(option, "background-load") == 0) {
+		bool val = parse_bool(filename, lineno, value, &err);
+		if (!err) {
+			tofi->background_load = val;
+		}
 	} else if (strcasecmp(option, "late-keyboard-init") == 0) {
 		bool val = parse_bool(filename, lineno, value, &err);
 		if (!err) {
@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include "desktop_vec.h"
 #include "fuzzy_match.h"
+#include "intern.h"
 #include "log.h"
 #include "string_vec.h"
 #include "unicode.h"
@@ -22,12 +23,6 @@ struct desktop_vec desktop_vec_create(void)
 
 void desktop_vec_destroy(struct desktop_vec *restrict vec)
 {
-	for (size_t i = 0; i < vec->count; i++) {
-		free(vec->buf[i].id);
-		free(vec->buf[i].name);
-		free(vec->buf[i].path);
-		free(vec->buf[i].keywords);
-	}
 	free(vec->buf);
 }
 
@@ -42,13 +37,19 @@ void desktop_vec_add(
 		vec->size *= 2;
 		vec->buf = xrealloc(vec->buf, vec->size * sizeof(vec->buf[0]));
 	}
-	vec->buf[vec->count].id = xstrdup(id);
-	vec->buf[vec->count].name = utf8_normalize(name);
-	if (vec->buf[vec->count].name == NULL) {
-		vec->buf[vec->count].name = xstrdup(name);
+	vec->buf[vec->count].id = intern(id);
+	vec->buf[vec->count].id_number = intern_id(vec->buf[vec->count].id);
+	char *normalized = utf8_normalize(name);
+	if (normalized == NULL) {
+		vec->buf[vec->count].name = intern(name);
+	} else {
+		vec->buf[vec->count].name = intern(normalized);
+		free(normalized);
 	}
-	vec->buf[vec->count].path = xstrdup(path);
-	vec->buf[vec->count].keywords = xstrdup(keywords);
+	vec->buf[vec->count].path = intern(path);
+	vec->buf[vec->count].keywords = intern(keywords);
+	/* There aren't many apps, so this is always worth doing. */
+	match_info_init(&vec->buf[vec->count].name_info, vec->buf[vec->count].name);
 	vec->buf[vec->count].search_score = 0;
 	vec->buf[vec->count].history_score = 0;
 	vec->count++;
@@ -137,53 +138,16 @@ void desktop_vec_sort(struct desktop_vec *restrict vec)
 
 struct desktop_entry *desktop_vec_find_sorted(struct desktop_vec *restrict vec, const char *name)
 {
-	/*
-	 * Explicitly cast away const-ness, as even though we won't modify the
-	 * name, the compiler rightly complains that we might.
-	 */
-	struct desktop_entry tmp = { .name = (char *)name };
+	struct desktop_entry tmp = { .name = name };
 	return bsearch(&tmp, vec->buf, vec->count, sizeof(vec->buf[0]), cmpdesktopp);
 }
 
 struct string_ref_vec desktop_vec_filter(
 		const struct desktop_vec *restrict vec,
-		const char *restrict substr,
-		bool fuzzy)
+		const struct query *restrict query)
 {
 	struct string_ref_vec filt = string_ref_vec_create();
-	for (size_t i = 0; i < vec->count; i++) {
-		int32_t search_score;
-		if (fuzzy) {
-			search_score = fuzzy_match_words(substr, vec->buf[i].name);
-		} else {
-			search_score = fuzzy_match_simple_words(substr, vec->buf[i].name);
-		}
-		if (search_score != INT32_MIN) {
-			string_ref_vec_add(&filt, vec->buf[i].name);
-			/*
-			 * Store the position of the match in the string as
-			 * its search_score, for later sorting.
-			 */
-			filt.buf[filt.count - 1].search_score = search_score;
-			filt.buf[filt.count - 1].history_score = vec->buf[i].history_score;
-		} else {
-			/* If we didn't match the name, check the keywords. */
-			if (fuzzy) {
-				search_score = fuzzy_match_words(substr, vec->buf[i].keywords);
-			} else {
-				search_score = fuzzy_match_simple_words(substr, vec->buf[i].keywords);
-			}
-			if (search_score != INT32_MIN) {
-				string_ref_vec_add(&filt, vec->buf[i].name);
-				/*
-				 * Arbitrary score addition to make name
-				 * matches preferred over keyword matches.
-				 */
-				filt.buf[filt.count - 1].search_score = search_score - 20;
-				filt.buf[filt.count - 1].history_score = vec->buf[i].history_score;
-			}
-		}
-	}
+	desktop_vec_filter_range(vec, 0, vec->count, query, &filt);
 	/*
 	 * Sort the results by this search_score. This moves matches at the beginnings
 	 * of words to the front of the result list.
@@ -192,6 +156,45 @@ struct string_ref_vec desktop_vec_filter(
 	return filt;
 }
 
+void desktop_vec_filter_range(
+		const struct desktop_vec *restrict vec,
+		size_t start,
+		size_t end,
+		const struct query *restrict query,
+		struct string_ref_vec *restrict filt)
+{
+	for (size_t i = start; i < end; i++) {
+		/*
+		 * Each word can match either the name or the keywords, but
+		 * negated words mustn't be in either.
+		 */
+		bool keyword_match;
+		int32_t search_score = query_match_either(
+				query,
+				vec->buf[i].name,
+				&vec->buf[i].name_info,
+				vec->buf[i].keywords,
+				&keyword_match);
+		if (search_score == INT32_MIN) {
+			continue;
+		}
+		if (keyword_match) {
+			/*
+			 * Arbitrary score addition to make name matches
+			 * preferred over keyword matches.
+			 */
+			search_score -= 20;
+		}
+		string_ref_vec_add(filt, vec->buf[i].name);
+		/*
+		 * Store the position of the match in the string as its
+		 * search_score, for later sorting.
+		 */
+		filt->buf[filt->count - 1].search_score = search_score;
+		filt->buf[filt->count - 1].history_score = vec->buf[i].history_score;
+	}
+}
+
 struct desktop_vec desktop_vec_load(FILE *file)
 {
 	struct desktop_vec vec = desktop_vec_create();
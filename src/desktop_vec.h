@@ -5,12 +5,19 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
+#include "fuzzy_match.h"
+#include "query.h"
+#include "string_vec.h"
 
+/* All of the strings here are interned, see intern.h. */
 struct desktop_entry {
-	char *id;
-	char *name;
-	char *path;
-	char *keywords;
+	const char *id;
+	const char *name;
+	const char *path;
+	const char *keywords;
+	/* The number of the interned id, for array lookups. */
+	uint32_t id_number;
+	struct match_info name_info;
 	uint32_t search_score;
 	uint32_t history_score;
 };
@@ -36,8 +43,18 @@ void desktop_vec_sort(struct desktop_vec *restrict vec);
 struct desktop_entry *desktop_vec_find_sorted(struct desktop_vec *restrict vec, const char *name);
 struct string_ref_vec desktop_vec_filter(
 		const struct desktop_vec *restrict vec,
-		const char *restrict substr,
-		bool fuzzy);
+		const struct query *restrict query);
+
+/*
+ * Filter the apps [start, end) of vec, appending any matches to filt, as
+ * with string_ref_vec_filter_range().
+ */
+void desktop_vec_filter_range(
+		const struct desktop_vec *restrict vec,
+		size_t start,
+		size_t end,
+		const struct query *restrict query,
+		struct string_ref_vec *restrict filt);
 
 struct desktop_vec desktop_vec_load(FILE *file);
 void desktop_vec_save(struct desktop_vec *restrict vec, FILE *restrict file);
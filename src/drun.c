@@ -9,52 +9,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include "cache_file.h"
 #include "drun.h"
 #include "history.h"
+#include "intern.h"
 #include "log.h"
-#include "mkdirp.h"
+#include "state_file.h"
 #include "string_vec.h"
 #include "xmalloc.h"
 
 static const char *default_data_dir = ".local/share/";
-static const char *default_cache_dir = ".cache/";
-static const char *cache_basename = "tofi-drun";
-
-[[nodiscard("memory leaked")]]
-static char *get_cache_path() {
-	char *cache_name = NULL;
-	const char *state_path = getenv("XDG_CACHE_HOME");
-	if (state_path == NULL) {
-		const char *home = getenv("HOME");
-		if (home == NULL) {
-			log_error("Couldn't retrieve HOME from environment.\n");
-			return NULL;
-		}
-		size_t len = strlen(home) + 1
-			+ strlen(default_cache_dir) + 1
-			+ strlen(cache_basename) + 1;
-		cache_name = xmalloc(len);
-		snprintf(
-			cache_name,
-			len,
-			"%s/%s/%s",
-			home,
-			default_cache_dir,
-			cache_basename);
-	} else {
-		size_t len = strlen(state_path) + 1
-			+ strlen(cache_basename) + 1;
-		cache_name = xmalloc(len);
-		snprintf(
-			cache_name,
-			len,
-			"%s/%s",
-			state_path,
-			cache_basename);
-	}
-	return cache_name;
-}
-
 [[nodiscard("memory leaked")]]
 static struct string_vec get_application_paths() {
 	char *base_paths = NULL;
@@ -214,67 +178,85 @@ struct desktop_vec drun_generate(void)
 	return apps;
 }
 
-struct desktop_vec drun_generate_cached()
+/*
+ * Stamp the cached apps with the modification times of the application
+ * directories, so that installing or removing an app invalidates them.
+ */
+uint64_t drun_stamp(void)
 {
-	log_debug("Retrieving cache location.\n");
-	char *cache_path = get_cache_path();
-
-	struct stat sb;
-	if (cache_path == NULL) {
-		return drun_generate();
+	struct string_vec application_path = get_application_paths();
+	uint64_t stamp = 0;
+	for (size_t i = 0; i < application_path.count; i++) {
+		const char *path = application_path.buf[i].string;
+		struct stat sb;
+		stamp = state_file_stamp(stamp, path, strlen(path) + 1);
+		if (stat(path, &sb) == 0) {
+			stamp = state_file_stamp(stamp, &sb.st_mtim, sizeof(sb.st_mtim));
+		}
 	}
+	string_vec_destroy(&application_path);
+	return stamp;
+}
 
-	/* If the cache doesn't exist, create it and return */
-	errno = 0;
-	if (stat(cache_path, &sb) == -1) {
-		if (errno == ENOENT) {
-			struct desktop_vec apps = drun_generate();
-			if (!mkdirp(cache_path)) {
-				free(cache_path);
-				return apps;
-			}
-			FILE *cache = fopen(cache_path, "wb");
-			desktop_vec_save(&apps, cache);
-			fclose(cache);
-			free(cache_path);
-			return apps;
-		}
-		free(cache_path);
-		return drun_generate();
+static struct desktop_vec load_cached_apps(const char *cache, size_t size)
+{
+	FILE *fp = fmemopen((void *)cache, size, "rb");
+	struct desktop_vec apps = desktop_vec_load(fp);
+	if (fp != NULL) {
+		fclose(fp);
 	}
+	return apps;
+}
 
+struct desktop_vec drun_generate_cached()
+{
 	log_debug("Retrieving application dirs.\n");
-	struct string_vec application_path = get_application_paths();;
+	uint64_t stamp = drun_stamp();
 
-	/* The cache exists, so check if it's still in date */
-	bool out_of_date = false;
-	for (size_t i = 0; i < application_path.count; i++) {
-		struct stat path_sb;
-		if (stat(application_path.buf[i].string, &path_sb) == 0) {
-			if (path_sb.st_mtim.tv_sec > sb.st_mtim.tv_sec) {
-				out_of_date = true;
-				break;
-			}
+	size_t size;
+	const char *cache = state_file_get(STATE_SECTION_DRUN_APPS, stamp, &size);
+	if (cache != NULL) {
+		log_debug("Cache up to date, loading.\n");
+		return load_cached_apps(cache, size);
+	}
+
+	/*
+	 * If another tofi is already regenerating the cache, e.g. because
+	 * lots were started at once after installing something, use the old
+	 * copy if there is one, or otherwise wait for theirs.
+	 */
+	int lock = state_file_lock_section(STATE_SECTION_DRUN_APPS, false);
+	if (lock == -1) {
+		cache = state_file_get_stale(STATE_SECTION_DRUN_APPS, &size);
+		if (cache != NULL) {
+			log_debug("Cache being updated elsewhere, using stale copy.\n");
+			return load_cached_apps(cache, size);
+		}
+		log_debug("Cache being updated elsewhere, waiting.\n");
+		lock = state_file_lock_section(STATE_SECTION_DRUN_APPS, true);
+		state_file_reload();
+		cache = state_file_get(STATE_SECTION_DRUN_APPS, stamp, &size);
+		if (cache != NULL) {
+			cache_unlock(lock);
+			return load_cached_apps(cache, size);
 		}
 	}
-	string_vec_destroy(&application_path);
 
-	struct desktop_vec apps;
-	if (out_of_date) {
-		log_debug("Cache out of date, updating.\n");
-		log_indent();
-		apps = drun_generate();
-		log_unindent();
-		FILE *cache = fopen(cache_path, "wb");
-		desktop_vec_save(&apps, cache);
-		fclose(cache);
-	} else {
-		log_debug("Cache up to date, loading.\n");
-		FILE *cache = fopen(cache_path, "rb");
-		apps = desktop_vec_load(cache);
-		fclose(cache);
+	log_debug("Cache missing or out of date, updating.\n");
+	log_indent();
+	struct desktop_vec apps = drun_generate();
+	log_unindent();
+
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fp = open_memstream(&buf, &len);
+	if (fp != NULL) {
+		desktop_vec_save(&apps, fp);
+		fclose(fp);
+		state_file_set(STATE_SECTION_DRUN_APPS, stamp, buf, len);
+		free(buf);
 	}
-	free(cache_path);
+	cache_unlock(lock);
 	return apps;
 }
 
@@ -374,6 +356,49 @@ void drun_launch(const char *filename)
 	g_object_unref(info);
 }
 
+/*
+ * Work out which program a desktop file runs, for prewarming. This is the
+ * TryExec key if there is one, or otherwise the first word of Exec, skipping
+ * over any leading `env VAR=value`. Returns NULL if we can't tell.
+ */
+char *drun_executable(const char *filename)
+{
+	GKeyFile *file = g_key_file_new();
+	if (!g_key_file_load_from_file(file, filename, G_KEY_FILE_NONE, NULL)) {
+		g_key_file_unref(file);
+		return NULL;
+	}
+	const char *group = "Desktop Entry";
+
+	char *result = NULL;
+	char *exec = g_key_file_get_string(file, group, "TryExec", NULL);
+	if (exec != NULL) {
+		result = xstrdup(exec);
+		g_free(exec);
+		g_key_file_unref(file);
+		return result;
+	}
+
+	exec = g_key_file_get_string(file, group, "Exec", NULL);
+	char **argv = NULL;
+	if (exec != NULL && g_shell_parse_argv(exec, NULL, &argv, NULL)) {
+		size_t i = 0;
+		if (argv[i] != NULL && strcmp(argv[i], "env") == 0) {
+			i++;
+			while (argv[i] != NULL && strchr(argv[i], '=') != NULL) {
+				i++;
+			}
+		}
+		if (argv[i] != NULL) {
+			result = xstrdup(argv[i]);
+		}
+		g_strfreev(argv);
+	}
+	g_free(exec);
+	g_key_file_unref(file);
+	return result;
+}
+
 static int cmpscorep(const void *restrict a, const void *restrict b)
 {
 	struct desktop_entry *restrict app1 = (struct desktop_entry *)a;
@@ -381,15 +406,62 @@ static int cmpscorep(const void *restrict a, const void *restrict b)
 	return app2->history_score - app1->history_score;
 }
 
+/*
+ * Give every app its history score, then sort by it.
+ *
+ * The history is keyed by desktop file ID, as unlike the name, that doesn't
+ * change with the locale or when an app is updated. Rather than searching the
+ * apps for every history entry, we first build a table mapping each ID to its
+ * index in apps, so that each entry is then just a hash lookup and an array
+ * index away from its app. IDs and history names are both interned, so the
+ * table can be keyed by address, without hashing or comparing any strings.
+ *
+ * Older versions of tofi keyed the history by name, so any entry that isn't a
+ * known ID is looked up by name instead (apps are still sorted by name at this
+ * point), and converted in-place. The converted history gets written out the
+ * next time something is launched.
+ */
 void drun_history_sort(struct desktop_vec *apps, struct history *history)
 {
 	log_debug("Moving already known apps to the front.\n");
+
+	/*
+	 * App IDs and history entries are both interned, so each app can be
+	 * found from the number of its ID. Indices are stored off-by-one, so
+	 * that 0 means "not found".
+	 */
+	size_t num_ids = intern_count();
+	size_t *ids = xcalloc(num_ids, sizeof(*ids));
+	for (size_t i = 0; i < apps->count; i++) {
+		ids[apps->buf[i].id_number] = i + 1;
+	}
+
+	bool migrated = false;
 	for (size_t i = 0; i < history->count; i++) {
-		struct desktop_entry *res = desktop_vec_find_sorted(apps, history->buf[i].name);
-		if (res == NULL) {
-			continue;
+		struct program *prog = &history->buf[i];
+		size_t index = ids[intern_id(prog->name)];
+		if (index == 0) {
+			struct desktop_entry *res = desktop_vec_find_sorted(apps, prog->name);
+			if (res == NULL) {
+				continue;
+			}
+			log_debug("Converting history entry \"%s\" to \"%s\".\n", prog->name, res->id);
+			prog->name = res->id;
+			index = res - apps->buf + 1;
+			migrated = true;
 		}
-		res->history_score = history->buf[i].run_count;
+		apps->buf[index - 1].history_score += prog->run_count;
+	}
+	free(ids);
+
+	/*
+	 * If the old history had both a name and an ID entry for the same
+	 * app, we now have duplicates. Their scores have already been summed
+	 * above, so merge them in the history too.
+	 */
+	if (migrated) {
+		history_merge_duplicates(history);
 	}
+
 	qsort(apps->buf, apps->count, sizeof(apps->buf[0]), cmpscorep);
 }
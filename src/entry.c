@@ -59,10 +59,20 @@ static void fixup_padding_sizes(struct directional *padding, uint32_t clip_width
 	}
 }
 
+static void init_background_patch(struct text_theme *theme)
+{
+	nine_patch_init(
+			&theme->background_patch,
+			theme->background_color,
+			theme->background_corner_radius);
+}
+
 void entry_init(struct entry *entry, uint8_t *restrict buffer, uint32_t width, uint32_t height)
 {
 	entry->image.width = width;
 	entry->image.height = height;
+	entry->image.damage.width = width;
+	entry->image.damage.height = height;
 
 	/*
 	 * Create the cairo surfaces and contexts we'll be using.
@@ -211,6 +221,17 @@ void entry_init(struct entry *entry, uint8_t *restrict buffer, uint32_t width, u
 	fixup_padding_sizes(&entry->alternate_result_theme.padding, width, height);
 	fixup_padding_sizes(&entry->selection_theme.padding, width, height);
 
+	/*
+	 * Pre-render the background boxes, as drawing rounded rectangles on
+	 * every frame is surprisingly slow.
+	 */
+	init_background_patch(&entry->prompt_theme);
+	init_background_patch(&entry->input_theme);
+	init_background_patch(&entry->placeholder_theme);
+	init_background_patch(&entry->default_result_theme);
+	init_background_patch(&entry->alternate_result_theme);
+	init_background_patch(&entry->selection_theme);
+
 	/*
 	 * Perform an initial render of the text.
 	 * This is done here rather than by calling entry_update to avoid the
@@ -259,6 +280,12 @@ void entry_destroy(struct entry *entry)
 	} else {
 		entry_backend_harfbuzz_destroy(entry);
 	}
+	nine_patch_destroy(&entry->prompt_theme.background_patch);
+	nine_patch_destroy(&entry->input_theme.background_patch);
+	nine_patch_destroy(&entry->placeholder_theme.background_patch);
+	nine_patch_destroy(&entry->default_result_theme.background_patch);
+	nine_patch_destroy(&entry->alternate_result_theme.background_patch);
+	nine_patch_destroy(&entry->selection_theme.background_patch);
 	cairo_destroy(entry->cairo[0].cr);
 	cairo_destroy(entry->cairo[1].cr);
 	cairo_surface_destroy(entry->cairo[0].surface);
@@ -270,6 +297,20 @@ void entry_update(struct entry *entry)
 	log_debug("Start rendering entry.\n");
 	cairo_t *cr = entry->cairo[entry->index].cr;
 
+	/*
+	 * If only the selection has moved, or we've scrolled by a row, most
+	 * of the last frame can be reused.
+	 */
+	if (!entry->use_pango && entry_backend_harfbuzz_update_rows(entry)) {
+		log_debug("Finish rendering entry.\n");
+		entry->index = !entry->index;
+		return;
+	}
+	entry->image.damage.x = 0;
+	entry->image.damage.y = 0;
+	entry->image.damage.width = entry->image.width;
+	entry->image.damage.height = entry->image.height;
+
 	/* Clear the image. */
 	struct color color = entry->background_color;
 	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
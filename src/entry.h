@@ -10,6 +10,8 @@
 #include "desktop_vec.h"
 #include "history.h"
 #include "image.h"
+#include "nine_patch.h"
+#include "query.h"
 #include "surface.h"
 #include "string_vec.h"
 
@@ -18,6 +20,7 @@
 #define MAX_FONT_NAME_LENGTH 256
 #define MAX_FONT_FEATURES_LENGTH 128
 #define MAX_FONT_VARIATIONS_LENGTH 128
+#define MAX_FONT_FALLBACK_LENGTH 1024
 
 struct directional {
 	int32_t top;
@@ -32,6 +35,9 @@ struct text_theme {
 	struct directional padding;
 	uint32_t background_corner_radius;
 
+	/* Pre-rendered background box, created by entry_init(). */
+	struct nine_patch background_patch;
+
 	bool foreground_specified;
 	bool background_specified;
 	bool padding_specified;
@@ -52,12 +58,21 @@ struct entry {
 	char input_utf8[4*MAX_INPUT_LENGTH];
 	uint32_t input_utf32_length;
 	uint32_t input_utf8_length;
+	/* Where in input_utf32 new characters go, normally the end. */
+	uint32_t cursor_position;
+	/* The input, compiled by compile_query() whenever it changes. */
+	struct query query;
 
 	uint32_t selection;
 	uint32_t first_result;
 	char *command_buffer;
 	struct string_ref_vec results;
 	struct string_ref_vec commands;
+	/*
+	 * With sort=false, results only cover the commands up to here, see
+	 * filter_more_results().
+	 */
+	size_t filter_position;
 	struct desktop_vec apps;
 	struct history history;
 	bool use_pango;
@@ -81,6 +96,7 @@ struct entry {
 	char font_name[MAX_FONT_NAME_LENGTH];
 	char font_features[MAX_FONT_FEATURES_LENGTH];
 	char font_variations[MAX_FONT_VARIATIONS_LENGTH];
+	char font_fallback[MAX_FONT_FALLBACK_LENGTH];
 	char prompt_text[MAX_PROMPT_LENGTH];
 	char placeholder_text[MAX_PROMPT_LENGTH];
 	uint32_t prompt_padding;
@@ -1,6 +1,14 @@
 #include <cairo/cairo.h>
-#include <harfbuzz/hb-ft.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <freetype/ftmm.h>
+#include <harfbuzz/hb-ot.h>
 #include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "harfbuzz.h"
 #include "../entry.h"
 #include "../log.h"
@@ -30,24 +38,17 @@ const struct {
 #undef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
-static void rounded_rectangle(cairo_t *cr, uint32_t width, uint32_t height, uint32_t r)
-{
-	cairo_new_path(cr);
-
-	/* Top-left */
-	cairo_arc(cr, r, r, r, -M_PI, -M_PI_2);
-
-	/* Top-right */
-	cairo_arc(cr, width - r, r, r, -M_PI_2, 0);
-
-	/* Bottom-right */
-	cairo_arc(cr, width - r, height - r, r, 0, M_PI_2);
-
-	/* Bottom-left */
-	cairo_arc(cr, r, height - r, r, M_PI_2, M_PI);
+/*
+ * Don't bother splitting the results into bands with fewer rows than this, as
+ * the overhead of waking a thread outweighs the benefit.
+ */
+#define MIN_ROWS_PER_BAND 4
 
-	cairo_close_path(cr);
-}
+/*
+ * If drawing a frame from the last one would mean redrawing more separate
+ * regions than this, it's just drawn from scratch.
+ */
+#define MAX_REDRAW_REGIONS 8
 
 static const char *get_ft_error_string(int err_code)
 {
@@ -82,22 +83,30 @@ static void setup_hb_buffer(hb_buffer_t *buffer)
  * Render a hb_buffer with Cairo, and return the extents of the rendered text
  * in Cairo units.
  */
-static cairo_text_extents_t render_hb_buffer(cairo_t *cr, hb_buffer_t *buffer)
+static cairo_text_extents_t render_hb_buffer(cairo_t *cr, struct harfbuzz_font *font, double ascent)
 {
+	hb_buffer_t *buffer = font->hb_buffer;
+
 	cairo_save(cr);
 
 	/*
 	 * Cairo uses y-down coordinates, but HarfBuzz uses y-up, so we
-	 * shift the text down by its ascent height to compensate.
+	 * shift the text down by its ascent height to compensate. This is
+	 * always the main font's ascent, so that fallback glyphs share its
+	 * baseline.
 	 */
-	cairo_font_extents_t font_extents;
-	cairo_font_extents(cr, &font_extents);
-	cairo_translate(cr, 0, font_extents.ascent);
+	cairo_translate(cr, 0, ascent);
 
 	unsigned int glyph_count;
 	hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
 	hb_glyph_position_t *glyph_pos = hb_buffer_get_glyph_positions(buffer, &glyph_count);
-	cairo_glyph_t *cairo_glyphs = xmalloc(sizeof(cairo_glyph_t) * glyph_count);
+	if (font->cairo_glyphs_size < glyph_count) {
+		font->cairo_glyphs_size = MAX(glyph_count, 2 * font->cairo_glyphs_size);
+		font->cairo_glyphs = xrealloc(
+				font->cairo_glyphs,
+				font->cairo_glyphs_size * sizeof(*font->cairo_glyphs));
+	}
+	cairo_glyph_t *cairo_glyphs = font->cairo_glyphs;
 
 	double x = 0;
 	double y = 0;
@@ -119,9 +128,7 @@ static cairo_text_extents_t render_hb_buffer(cairo_t *cr, hb_buffer_t *buffer)
 	cairo_glyph_extents(cr, cairo_glyphs, glyph_count, &extents);
 
 	/* Account for the shifted baseline in our returned text extents. */
-	extents.y_bearing += font_extents.ascent;
-
-	free(cairo_glyphs);
+	extents.y_bearing += ascent;
 
 	cairo_restore(cr);
 
@@ -129,21 +136,200 @@ static cairo_text_extents_t render_hb_buffer(cairo_t *cr, hb_buffer_t *buffer)
 }
 
 /*
- * Clear the harfbuzz buffer, shape some text and render it with Cairo,
- * returning the extents of the rendered text in Cairo units.
+ * Return the index of the first face with a glyph for codepoint, or the main
+ * font's if none do, so that it draws its missing glyph box.
+ *
+ * FreeType's cmap lookups aren't free, and the same few characters tend to
+ * come up again and again, so results are cached.
+ */
+static uint8_t face_for_codepoint(struct harfbuzz_font *font, uint32_t codepoint)
+{
+	struct coverage_entry *cached = &font->coverage[codepoint & (COVERAGE_CACHE_SIZE - 1)];
+	if (cached->codepoint == codepoint) {
+		return cached->face;
+	}
+
+	uint8_t face = 0;
+	for (uint8_t i = 0; i < font->num_faces; i++) {
+		hb_codepoint_t glyph;
+		if (hb_font_get_nominal_glyph(font->faces[i].hb_font, codepoint, &glyph)) {
+			face = i;
+			break;
+		}
+	}
+	cached->codepoint = codepoint;
+	cached->face = face;
+	return face;
+}
+
+/*
+ * Add the extents of some text drawn at the end of the text in extents,
+ * i.e. offset by its x_advance.
+ */
+static void append_extents(cairo_text_extents_t *extents, const cairo_text_extents_t *next)
+{
+	if (next->width > 0 && next->height > 0) {
+		if (extents->width > 0 && extents->height > 0) {
+			double left = MIN(extents->x_bearing, extents->x_advance + next->x_bearing);
+			double right = MAX(
+					extents->x_bearing + extents->width,
+					extents->x_advance + next->x_bearing + next->width);
+			double top = MIN(extents->y_bearing, next->y_bearing);
+			double bottom = MAX(
+					extents->y_bearing + extents->height,
+					next->y_bearing + next->height);
+			extents->x_bearing = left;
+			extents->width = right - left;
+			extents->y_bearing = top;
+			extents->height = bottom - top;
+		} else {
+			extents->x_bearing = extents->x_advance + next->x_bearing;
+			extents->width = next->width;
+			extents->y_bearing = next->y_bearing;
+			extents->height = next->height;
+		}
+	}
+	extents->x_advance += next->x_advance;
+	extents->y_advance += next->y_advance;
+}
+
+/*
+ * Clear the harfbuzz buffer, shape length bytes of text starting at start,
+ * and render them with Cairo, returning the extents of the rendered text in
+ * Cairo units. The rest of text is passed along to HarfBuzz as context, so
+ * drawing a string in pieces (e.g. for match highlighting) doesn't need any
+ * copies of it.
+ *
+ * If we've got fallback fonts, the text is split into runs by which face
+ * covers each character, and each run is shaped and drawn separately.
+ * Spaces are left in the current run, so that runs of e.g. CJK text with
+ * spaces between words aren't split up needlessly.
  */
 static cairo_text_extents_t render_text(
 		cairo_t *cr,
 		struct entry_backend_harfbuzz *hb,
-		const char *text)
+		struct harfbuzz_font *font,
+		const char *text,
+		size_t start,
+		size_t length)
+{
+	cairo_font_extents_t font_extents;
+	cairo_font_extents(cr, &font_extents);
+
+	if (font->num_faces == 1) {
+		hb_buffer_clear_contents(font->hb_buffer);
+		setup_hb_buffer(font->hb_buffer);
+		hb_buffer_add_utf8(font->hb_buffer, text, -1, start, length);
+		hb_shape(font->faces[0].hb_font, font->hb_buffer, hb->hb_features, hb->num_features);
+		return render_hb_buffer(cr, font, font_extents.ascent);
+	}
+
+	cairo_save(cr);
+	cairo_text_extents_t extents = { 0 };
+	const char *run = &text[start];
+	const char *text_end = run + length;
+	while (run < text_end) {
+		uint8_t face = face_for_codepoint(font, utf8_to_utf32(run));
+		const char *end = utf8_next_char(run);
+		while (end < text_end) {
+			uint32_t c = utf8_to_utf32(end);
+			if (!utf32_isspace(c) && face_for_codepoint(font, c) != face) {
+				break;
+			}
+			end = utf8_next_char(end);
+		}
+
+		/*
+		 * Pass the whole string to HarfBuzz, so that it can see the
+		 * context around this run.
+		 */
+		hb_buffer_clear_contents(font->hb_buffer);
+		setup_hb_buffer(font->hb_buffer);
+		hb_buffer_add_utf8(font->hb_buffer, text, -1, run - text, end - run);
+		hb_shape(font->faces[face].hb_font, font->hb_buffer, hb->hb_features, hb->num_features);
+
+		cairo_set_font_face(cr, font->faces[face].cairo_face);
+		cairo_text_extents_t subextents = render_hb_buffer(cr, font, font_extents.ascent);
+		cairo_translate(cr, subextents.x_advance, 0);
+		append_extents(&extents, &subextents);
+
+		run = end;
+	}
+	cairo_restore(cr);
+	return extents;
+}
+
+
+/*
+ * Work out how far drawing length bytes of text would advance, without
+ * drawing anything. Runs are split between faces just as in render_text().
+ */
+static double text_advance(
+		struct entry_backend_harfbuzz *hb,
+		struct harfbuzz_font *font,
+		const char *text,
+		size_t length)
 {
-	hb_buffer_clear_contents(hb->hb_buffer);
-	setup_hb_buffer(hb->hb_buffer);
-	hb_buffer_add_utf8(hb->hb_buffer, text, -1, 0, -1);
-	hb_shape(hb->hb_font, hb->hb_buffer, hb->hb_features, hb->num_features);
-	return render_hb_buffer(cr, hb->hb_buffer);
+	double advance = 0;
+	const char *run = text;
+	const char *text_end = text + length;
+	while (run < text_end) {
+		uint8_t face = 0;
+		const char *end = text_end;
+		if (font->num_faces > 1) {
+			face = face_for_codepoint(font, utf8_to_utf32(run));
+			end = utf8_next_char(run);
+			while (end < text_end) {
+				uint32_t c = utf8_to_utf32(end);
+				if (!utf32_isspace(c) && face_for_codepoint(font, c) != face) {
+					break;
+				}
+				end = utf8_next_char(end);
+			}
+		}
+
+		hb_buffer_clear_contents(font->hb_buffer);
+		setup_hb_buffer(font->hb_buffer);
+		hb_buffer_add_utf8(font->hb_buffer, text, -1, run - text, end - run);
+		hb_shape(font->faces[face].hb_font, font->hb_buffer, hb->hb_features, hb->num_features);
+
+		unsigned int glyph_count;
+		hb_glyph_position_t *glyph_pos = hb_buffer_get_glyph_positions(font->hb_buffer, &glyph_count);
+		for (unsigned int i = 0; i < glyph_count; i++) {
+			advance += glyph_pos[i].x_advance / 64.0;
+		}
+
+		run = end;
+	}
+	return advance;
 }
 
+/*
+ * Draw the text cursor in front of the character at cursor_position in the
+ * input text, which has just been drawn at the current origin. The cursor
+ * is only drawn once it's been moved away from the end, so nothing changes
+ * for people who never move it.
+ */
+static void render_cursor(cairo_t *cr, struct entry *entry, const char *text)
+{
+	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
+	if (entry->cursor_position >= entry->input_utf32_length) {
+		return;
+	}
+
+	const char *end = text;
+	for (uint32_t i = 0; i < entry->cursor_position && *end != '\0'; i++) {
+		end = utf8_next_char(end);
+	}
+	double x = text_advance(hb, &hb->font, text, end - text);
+
+	cairo_font_extents_t font_extents;
+	cairo_font_extents(cr, &font_extents);
+	struct color color = entry->input_theme.foreground_color;
+	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+	cairo_rectangle(cr, round(x), 0, ceil(font_extents.height / 16), font_extents.height);
+	cairo_fill(cr);
+}
 
 /*
  * Render some text with an optional background box, using settings from the
@@ -152,6 +338,7 @@ static cairo_text_extents_t render_text(
 static cairo_text_extents_t render_text_themed(
 		cairo_t *cr,
 		struct entry_backend_harfbuzz *hb,
+		struct harfbuzz_font *font,
 		const char *text,
 		const struct text_theme *theme)
 {
@@ -171,7 +358,8 @@ static cairo_text_extents_t render_text_themed(
 	 */
 	struct color color = theme->foreground_color;
 	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-	cairo_text_extents_t extents = render_text(cr, hb, text);
+	size_t length = strlen(text);
+	cairo_text_extents_t extents = render_text(cr, hb, font, text, 0, length);
 
 	if (theme->background_color.a == 0) {
 		/* No background to draw, we're done. */
@@ -179,24 +367,177 @@ static cairo_text_extents_t render_text_themed(
 	}
 
 	cairo_save(cr);
-	color = theme->background_color;
-	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
 	cairo_translate(
 			cr,
 			floor(-padding.left + extents.x_bearing),
 			-padding.top);
-	rounded_rectangle(
+	nine_patch_draw(
 			cr,
+			&theme->background_patch,
 			ceil(extents.width + padding.left + padding.right),
-			ceil(font_extents.height + padding.top + padding.bottom),
-			theme->background_corner_radius
+			ceil(font_extents.height + padding.top + padding.bottom)
 			);
-	cairo_fill(cr);
 	cairo_restore(cr);
 
 	color = theme->foreground_color;
 	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-	render_text(cr, hb, text);
+	render_text(cr, hb, font, text, 0, length);
+	return extents;
+}
+
+/*
+ * Render a single result at the current origin, using the appropriate theme
+ * and with match highlighting if it's the selection.
+ */
+static cairo_text_extents_t render_result(
+		cairo_t *cr,
+		struct entry *entry,
+		struct harfbuzz_font *font,
+		size_t i,
+		size_t index)
+{
+	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
+	cairo_text_extents_t extents;
+	const char *result = entry->results.buf[index].string;
+
+	/*
+	 * If this isn't the selected result, or it is but we're not doing any
+	 * fancy match-highlighting, just print as normal.
+	 */
+	if (i != entry->selection || (entry->selection_highlight_color.a == 0)) {
+		const struct text_theme *theme;
+		if (i == entry->selection) {
+			theme = &entry->selection_theme;
+		} else if (index % 2) {
+			theme = &entry->alternate_result_theme;
+		} else {
+			theme = &entry->default_result_theme;
+		}
+		return render_text_themed(cr, hb, font, result, theme);
+	}
+
+	/*
+	 * For match highlighting, there's a bit more to do.
+	 *
+	 * We need to split the text into prematch, match and postmatch chunks,
+	 * and draw each separately.
+	 *
+	 * However, we only want one background box around them all (if we're
+	 * drawing one). To do this, we have to do the rendering part of
+	 * render_text_themed() manually, with the same method of:
+	 * - Draw the text and measure it
+	 * - Draw the box
+	 * - Draw the text again
+	 */
+	cairo_font_extents_t font_extents;
+	cairo_font_extents(cr, &font_extents);
+
+	/*
+	 * The match is drawn as up to three pieces of the original string,
+	 * [0, match_start), [match_start, match_end) and [match_end, length).
+	 */
+	size_t length = strlen(result);
+	size_t match_start = length;
+	size_t match_end = length;
+	if (entry->input_utf8_length > 0 && entry->selection_highlight_color.a != 0) {
+		const char *match_pos = utf8_strcasestr(result, entry->input_utf8);
+		if (match_pos != NULL) {
+			match_start = match_pos - result;
+			match_end = MIN(match_start + entry->input_utf8_length, length);
+		}
+	}
+	bool match = match_start < length;
+	bool postmatch = match_end < length;
+
+	for (int pass = 0; pass < 2; pass++) {
+		cairo_save(cr);
+		struct color color = entry->selection_theme.foreground_color;
+		cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+
+		cairo_text_extents_t subextents = render_text(cr, hb, font, result, 0, match_start);
+		extents = subextents;
+
+		if (match) {
+			cairo_translate(cr, subextents.x_advance, 0);
+			color = entry->selection_highlight_color;
+			cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+
+			subextents = render_text(
+					cr,
+					hb,
+					font,
+					result,
+					match_start,
+					match_end - match_start);
+
+			if (match_start == 0) {
+				extents = subextents;
+			} else {
+				/*
+				 * This calculation is a little complex, but
+				 * it's basically:
+				 *
+				 * (distance from leftmost pixel of prematch to
+				 * logical end of prematch)
+				 *
+				 * +
+				 *
+				 * (distance from logical start of match to
+				 * rightmost pixel of match).
+				 */
+				extents.width = extents.x_advance
+					- extents.x_bearing
+					+ subextents.x_bearing
+					+ subextents.width;
+				extents.x_advance += subextents.x_advance;
+			}
+		}
+
+		if (postmatch) {
+			cairo_translate(cr, subextents.x_advance, 0);
+			color = entry->selection_theme.foreground_color;
+			cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+			subextents = render_text(
+					cr,
+					hb,
+					font,
+					result,
+					match_end,
+					length - match_end);
+
+			extents.width = extents.x_advance
+				- extents.x_bearing
+				+ subextents.x_bearing
+				+ subextents.width;
+			extents.x_advance += subextents.x_advance;
+		}
+
+		cairo_restore(cr);
+
+		if (entry->selection_theme.background_color.a == 0) {
+			/* No background box, we're done. */
+			break;
+		} else if (pass == 0) {
+			/*
+			 * First pass, paint over the text with our background
+			 * box.
+			 */
+			struct directional padding = entry->selection_theme.padding;
+			cairo_save(cr);
+			cairo_translate(
+					cr,
+					floor(-padding.left + extents.x_bearing),
+					-padding.top);
+			nine_patch_draw(
+					cr,
+					&entry->selection_theme.background_patch,
+					ceil(extents.width + padding.left + padding.right),
+					ceil(font_extents.height + padding.top + padding.bottom)
+					);
+			cairo_restore(cr);
+		}
+	}
+
 	return extents;
 }
 
@@ -217,57 +558,98 @@ static bool size_overflows(struct entry *entry, uint32_t width, uint32_t height)
 	return false;
 }
 
-void entry_backend_harfbuzz_init(
-		struct entry *entry,
-		uint32_t *width,
-		uint32_t *height)
-{
-	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
-	cairo_t *cr = entry->cairo[0].cr;
-	uint32_t font_size = floor(entry->font_size * PT_TO_DPI);
+struct mapping {
+	void *data;
+	size_t size;
+};
 
-	/*
-	 * Setting up our font has three main steps:
-	 *
-	 * 1. Load the font face with FreeType.
-	 * 2. Create a HarfBuzz font referencing the FreeType font.
-	 * 3. Create a Cairo font referencing the FreeType font.
-	 *
-	 * The simultaneous interaction of Cairo and HarfBuzz with FreeType is
-	 * a little finicky, so the order of the last two steps is important.
-	 * We use HarfBuzz to set font variation settings (such as weight), if
-	 * any. This modifies the underlying FreeType font, so we must create
-	 * the Cairo font *after* this point for the changes to take effect.
-	 *
-	 * This doesn't seem like it should be necessary, as both HarfBuzz and
-	 * Cairo reference the same FreeType font, but it is.
-	 */
+static void unmap_font_file(void *user_data)
+{
+	struct mapping *mapping = user_data;
+	munmap(mapping->data, mapping->size);
+	free(mapping);
+}
 
-	/* Setup FreeType. */
-	log_debug("Creating FreeType library.\n");
-	int err;
-	err = FT_Init_FreeType(&hb->ft_library);
-	if (err) {
-		log_error("Error initialising FreeType: %s\n",
-				get_ft_error_string(err));
-		exit(EXIT_FAILURE);
+/*
+ * Map a font file into memory, and create a HarfBuzz face for it. Returns
+ * false on error.
+ */
+static bool font_file_init(struct font_file *file, const char *filename)
+{
+	errno = 0;
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		log_error("Error opening font \"%s\": %s\n", filename, strerror(errno));
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		log_error("Error reading font \"%s\": %s\n", filename, strerror(errno));
+		close(fd);
+		return false;
+	}
+	if (st.st_size == 0 || st.st_size > UINT32_MAX) {
+		log_error("Error reading font \"%s\": bad file size.\n", filename);
+		close(fd);
+		return false;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		log_error("Error mapping font \"%s\": %s\n", filename, strerror(errno));
+		return false;
 	}
 
-	log_debug("Loading FreeType font.\n");
-	err = FT_New_Face(
+	struct mapping *mapping = xmalloc(sizeof(*mapping));
+	mapping->data = data;
+	mapping->size = st.st_size;
+	file->filename = filename;
+	file->blob = hb_blob_create(
+			data,
+			st.st_size,
+			HB_MEMORY_MODE_READONLY,
+			mapping,
+			unmap_font_file);
+	file->hb_face = hb_face_create(file->blob, 0);
+	return true;
+}
+
+static void font_file_destroy(struct font_file *file)
+{
+	hb_face_destroy(file->hb_face);
+	hb_blob_destroy(file->blob);
+}
+
+/*
+ * Load a single font file, using the size and variations already stored in
+ * hb. Returns false on error.
+ *
+ * Shaping is done by HarfBuzz's own OpenType code, straight from the mapped
+ * file, rather than calling back into FreeType for every glyph, so FreeType
+ * is only used by Cairo for drawing.
+ */
+static bool harfbuzz_face_init(
+		struct harfbuzz_face *face,
+		struct entry_backend_harfbuzz *hb,
+		const struct font_file *file)
+{
+	unsigned int size;
+	const char *data = hb_blob_get_data(file->blob, &size);
+	int err = FT_New_Memory_Face(
 			hb->ft_library,
-			entry->font_name,
+			(const FT_Byte *)data,
+			size,
 			0,
-			&hb->ft_face);
+			&face->ft_face);
 	if (err) {
-		log_error("Error loading font: %s\n", get_ft_error_string(err));
-		exit(EXIT_FAILURE);
+		log_error("Error loading font \"%s\": %s\n", file->filename, get_ft_error_string(err));
+		return false;
 	}
 
 	err = FT_Set_Char_Size(
-			hb->ft_face,
-			font_size * 64,
-			font_size * 64,
+			face->ft_face,
+			hb->font_size * 64,
+			hb->font_size * 64,
 			0,
 			0);
 	if (err) {
@@ -275,56 +657,91 @@ void entry_backend_harfbuzz_init(
 				get_ft_error_string(err));
 	}
 
-	log_debug("Creating Harfbuzz font.\n");
-	hb->hb_font = hb_ft_font_create_referenced(hb->ft_face);
+	/*
+	 * Scale the HarfBuzz font from FreeType's size metrics, as hb-ft does,
+	 * so that positions come out in the same 26.6 format and any rounding
+	 * FreeType did to the size is carried over. Advances then match
+	 * FreeType's unhinted ones to within HarfBuzz's rounding.
+	 */
+	const FT_Size_Metrics *metrics = &face->ft_face->size->metrics;
+	uint64_t upem = face->ft_face->units_per_EM;
+	face->hb_font = hb_font_create(file->hb_face);
+	hb_ot_font_set_funcs(face->hb_font);
+	hb_font_set_scale(
+			face->hb_font,
+			((uint64_t)metrics->x_scale * upem + (1u << 15)) >> 16,
+			((uint64_t)metrics->y_scale * upem + (1u << 15)) >> 16);
+	hb_font_set_ppem(face->hb_font, metrics->x_ppem, metrics->y_ppem);
 
-	if (entry->font_variations[0] != 0) {
-		log_debug("Parsing font variations.\n");
-	}
-	char *saveptr = NULL;
-	char *variation = strtok_r(entry->font_variations, ",", &saveptr);
-	while (variation != NULL && hb->num_variations < N_ELEM(hb->hb_variations)) {
-		if (hb_variation_from_string(variation, -1, &hb->hb_variations[hb->num_variations])) {
-			hb->num_variations++;
-		} else {
-			log_error("Failed to parse font variation \"%s\".\n", variation);
+	/*
+	 * We need to set variations now and copy them over to the FreeType
+	 * font, as Cairo will then use the FreeType font for drawing. Both
+	 * use the same normalised coordinates, HarfBuzz's in 2.14 format and
+	 * FreeType's in 16.16.
+	 */
+	hb_font_set_variations(face->hb_font, hb->hb_variations, hb->num_variations);
+	unsigned int num_coords;
+	const int *coords = hb_font_get_var_coords_normalized(face->hb_font, &num_coords);
+	if (num_coords > 0) {
+		FT_Fixed ft_coords[num_coords];
+		for (unsigned int i = 0; i < num_coords; i++) {
+			ft_coords[i] = (FT_Fixed)coords[i] * 4;
 		}
-		variation = strtok_r(NULL, ",", &saveptr);
+		FT_Set_Var_Blend_Coordinates(face->ft_face, num_coords, ft_coords);
 	}
 
-	/*
-	 * We need to set variations now and update the underlying FreeType
-	 * font, as Cairo will then use the FreeType font for drawing.
-	 */
-	hb_font_set_variations(hb->hb_font, hb->hb_variations, hb->num_variations);
-#ifndef NO_HARFBUZZ_FONT_CHANGED
-	hb_ft_hb_font_changed(hb->hb_font);
-#endif
+	face->cairo_face = cairo_ft_font_face_create_for_ft_face(face->ft_face, 0);
+	return true;
+}
 
-	if (entry->font_features[0] != 0) {
-		log_debug("Parsing font features.\n");
+static void harfbuzz_face_destroy(struct harfbuzz_face *face)
+{
+	hb_font_destroy(face->hb_font);
+	cairo_font_face_destroy(face->cairo_face);
+	FT_Done_Face(face->ft_face);
+}
+
+/*
+ * Load our main font and any fallbacks for use by one thread. Returns false
+ * if the main font couldn't be loaded, but broken fallbacks are skipped.
+ */
+static bool harfbuzz_font_init(
+		struct harfbuzz_font *font,
+		struct entry_backend_harfbuzz *hb)
+{
+	if (!harfbuzz_face_init(&font->faces[0], hb, &hb->files[0])) {
+		return false;
 	}
-	saveptr = NULL;
-	char *feature = strtok_r(entry->font_features, ",", &saveptr);
-	while (feature != NULL && hb->num_features < N_ELEM(hb->hb_features)) {
-		if (hb_feature_from_string(feature, -1, &hb->hb_features[hb->num_features])) {
-			hb->num_features++;
-		} else {
-			log_error("Failed to parse font feature \"%s\".\n", feature);
+	font->num_faces = 1;
+	for (uint8_t i = 1; i < hb->num_files; i++) {
+		if (harfbuzz_face_init(&font->faces[font->num_faces], hb, &hb->files[i])) {
+			font->num_faces++;
 		}
-		feature = strtok_r(NULL, ",", &saveptr);
 	}
 
-	log_debug("Creating Harfbuzz buffer.\n");
-	hb->hb_buffer = hb_buffer_create();
+	memset(font->coverage, 0, sizeof(font->coverage));
+	font->hb_buffer = hb_buffer_create();
+	font->cairo_glyphs = NULL;
+	font->cairo_glyphs_size = 0;
+	return true;
+}
 
-	log_debug("Creating Cairo font.\n");
-	hb->cairo_face = cairo_ft_font_face_create_for_ft_face(hb->ft_face, 0);
+static void harfbuzz_font_destroy(struct harfbuzz_font *font)
+{
+	free(font->cairo_glyphs);
+	hb_buffer_destroy(font->hb_buffer);
+	for (uint8_t i = 0; i < font->num_faces; i++) {
+		harfbuzz_face_destroy(&font->faces[i]);
+	}
+}
 
-	struct color color = entry->foreground_color;
-	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-	cairo_set_font_face(cr, hb->cairo_face);
-	cairo_set_font_size(cr, font_size);
+static void set_cairo_font(
+		cairo_t *cr,
+		struct entry_backend_harfbuzz *hb,
+		struct harfbuzz_font *font)
+{
+	cairo_set_font_face(cr, font->faces[0].cairo_face);
+	cairo_set_font_size(cr, hb->font_size);
 	cairo_font_options_t *opts = cairo_font_options_create();
 	if (hb->disable_hinting) {
 		cairo_font_options_set_hint_style(opts, CAIRO_HINT_STYLE_NONE);
@@ -332,67 +749,854 @@ void entry_backend_harfbuzz_init(
 		cairo_font_options_set_hint_metrics(opts, CAIRO_HINT_METRICS_ON);
 	}
 	cairo_set_font_options(cr, opts);
-
-	/* We also need to set up the font for our other Cairo context. */
-	cairo_set_font_face(entry->cairo[1].cr, hb->cairo_face);
-	cairo_set_font_size(entry->cairo[1].cr, font_size);
-	cairo_set_font_options(entry->cairo[1].cr, opts);
-
 	cairo_font_options_destroy(opts);
 }
 
-void entry_backend_harfbuzz_destroy(struct entry *entry)
+/*
+ * Draw every row of the current frame which touches this band, clipped to
+ * the band's slice of the buffer.
+ */
+static void render_band(struct render_band *band)
 {
-	hb_buffer_destroy(entry->harfbuzz.hb_buffer);
-	hb_font_destroy(entry->harfbuzz.hb_font);
-	cairo_font_face_destroy(entry->harfbuzz.cairo_face);
-	FT_Done_Face(entry->harfbuzz.ft_face);
-	FT_Done_FreeType(entry->harfbuzz.ft_library);
-}
+	struct entry *entry = band->entry;
+	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
+	struct render_pool *pool = &hb->pool;
 
-void entry_backend_harfbuzz_update(struct entry *entry)
-{
-	cairo_t *cr = entry->cairo[entry->index].cr;
-	cairo_text_extents_t extents;
+	/* Band 0 is drawn on the main thread, so uses the main font. */
+	struct harfbuzz_font *font = band == &pool->bands[0] ? &hb->font : &band->font;
 
-	cairo_save(cr);
+	/*
+	 * Only create a new context if the band has moved, as creating one
+	 * every frame means a handful of allocations per thread.
+	 */
+	struct band_context *context = &band->cairo[entry->index];
+	if (context->cr == NULL
+			|| context->y_start != band->y_start
+			|| context->y_end != band->y_end) {
+		if (context->cr != NULL) {
+			cairo_destroy(context->cr);
+			cairo_surface_destroy(context->surface);
+		}
+		cairo_surface_t *target = entry->cairo[entry->index].surface;
+		int stride = cairo_image_surface_get_stride(target);
+		unsigned char *data = cairo_image_surface_get_data(target);
+
+		context->surface = cairo_image_surface_create_for_data(
+				&data[band->y_start * stride],
+				CAIRO_FORMAT_ARGB32,
+				entry->image.width,
+				band->y_end - band->y_start,
+				stride);
+		context->cr = cairo_create(context->surface);
+		context->y_start = band->y_start;
+		context->y_end = band->y_end;
+		set_cairo_font(context->cr, hb, font);
+	}
+	cairo_t *cr = context->cr;
 
-	/* Render the prompt */
-	extents = render_text_themed(cr, &entry->harfbuzz, entry->prompt_text, &entry->prompt_theme);
+	cairo_save(cr);
+	cairo_rectangle(
+			cr,
+			entry->clip_x,
+			(double)entry->clip_y - band->y_start,
+			entry->clip_width,
+			entry->clip_height);
+	cairo_clip(cr);
 
-	cairo_translate(cr, extents.x_advance, 0);
-	cairo_translate(cr, entry->prompt_padding, 0);
+	struct color color = entry->foreground_color;
+	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
 
-	/* Render the entry text */
-	if (entry->input_utf8_length == 0) {
-		extents = render_text_themed(cr, &entry->harfbuzz, entry->placeholder_text, &entry->placeholder_theme);
-	} else if (entry->hide_input) {
-		size_t nchars = entry->input_utf32_length;
-		size_t char_size = entry->hidden_character_utf8_length;
-		char *buf = xmalloc(1 + nchars * char_size);
-		for (size_t i = 0; i < nchars; i++) {
-			for (size_t j = 0; j < char_size; j++) {
-				buf[i * char_size + j] = entry->hidden_character_utf8[j];
-			}
+	for (size_t i = 0; i < pool->num_rows; i++) {
+		double y = pool->row_y[i];
+		if (y + pool->extent_below <= band->y_start) {
+			continue;
 		}
-		buf[char_size * nchars] = '\0';
-
-		extents = render_text_themed(cr, &entry->harfbuzz, buf, &entry->input_theme);
-		free(buf);
-	} else {
-		extents = render_text_themed(cr, &entry->harfbuzz, entry->input_utf8, &entry->input_theme);
+		if (y - pool->extent_above >= band->y_end) {
+			break;
+		}
+		cairo_matrix_t mat;
+		cairo_matrix_init_translate(&mat, pool->row_x, y - band->y_start);
+		cairo_set_matrix(cr, &mat);
+		render_result(cr, entry, font, i, i + entry->first_result);
 	}
-	extents.x_advance = MAX(extents.x_advance, entry->input_width);
 
-	cairo_font_extents_t font_extents;
-	cairo_font_extents(cr, &font_extents);
+	cairo_restore(cr);
+}
 
-	uint32_t num_results;
-	if (entry->num_results == 0) {
-		num_results = entry->results.count;
+static void render_band_destroy(struct render_band *band)
+{
+	for (size_t i = 0; i < N_ELEM(band->cairo); i++) {
+		if (band->cairo[i].cr != NULL) {
+			cairo_destroy(band->cairo[i].cr);
+			cairo_surface_destroy(band->cairo[i].surface);
+			band->cairo[i].cr = NULL;
+		}
+	}
+}
+
+static int render_thread(void *arg)
+{
+	struct render_band *band = arg;
+	struct render_pool *pool = &band->entry->harfbuzz.pool;
+	size_t id = band - pool->bands;
+
+	mtx_lock(&pool->lock);
+	while (true) {
+		while (pool->generation == band->generation && !pool->quit) {
+			cnd_wait(&pool->start, &pool->lock);
+		}
+		if (pool->quit) {
+			break;
+		}
+		band->generation = pool->generation;
+		if (id >= pool->num_bands) {
+			continue;
+		}
+		mtx_unlock(&pool->lock);
+
+		render_band(band);
+
+		mtx_lock(&pool->lock);
+		pool->num_busy--;
+		if (pool->num_busy == 0) {
+			cnd_signal(&pool->done);
+		}
+	}
+	mtx_unlock(&pool->lock);
+	return 0;
+}
+
+static void render_pool_start(struct entry *entry)
+{
+	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
+	struct render_pool *pool = &hb->pool;
+
+	pool->started = true;
+
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_cpus < 2) {
+		return;
+	}
+	uint8_t num_threads = MIN(num_cpus, MAX_RENDER_THREADS);
+
+	log_debug("Starting %hhu render threads.\n", num_threads - 1);
+	mtx_init(&pool->lock, mtx_plain);
+	cnd_init(&pool->start);
+	cnd_init(&pool->done);
+
+	/* The main thread draws the first band with the main font. */
+	pool->bands[0].entry = entry;
+	pool->num_threads = 1;
+
+	for (uint8_t i = 1; i < num_threads; i++) {
+		struct render_band *band = &pool->bands[i];
+		band->entry = entry;
+		if (!harfbuzz_font_init(&band->font, hb)) {
+			break;
+		}
+		/*
+		 * The thread may not get to run until after the first frame's
+		 * been requested, so it has to know which one it's waiting for
+		 * before it starts, or it'll miss it.
+		 */
+		band->generation = pool->generation;
+		if (thrd_create(&band->thread, render_thread, band) != thrd_success) {
+			log_error("Couldn't start render thread.\n");
+			harfbuzz_font_destroy(&band->font);
+			break;
+		}
+		pool->num_threads++;
+	}
+
+	if (pool->num_threads < 2) {
+		mtx_destroy(&pool->lock);
+		cnd_destroy(&pool->start);
+		cnd_destroy(&pool->done);
+		pool->num_threads = 0;
+	}
+}
+
+static void render_pool_destroy(struct render_pool *pool)
+{
+	if (pool->num_threads < 2) {
+		free(pool->row_y);
+		return;
+	}
+
+	mtx_lock(&pool->lock);
+	pool->quit = true;
+	cnd_broadcast(&pool->start);
+	mtx_unlock(&pool->lock);
+
+	for (uint8_t i = 1; i < pool->num_threads; i++) {
+		thrd_join(pool->bands[i].thread, NULL);
+		harfbuzz_font_destroy(&pool->bands[i].font);
+	}
+	for (uint8_t i = 0; i < pool->num_threads; i++) {
+		render_band_destroy(&pool->bands[i]);
+	}
+	mtx_destroy(&pool->lock);
+	cnd_destroy(&pool->start);
+	cnd_destroy(&pool->done);
+	free(pool->row_y);
+}
+
+/*
+ * Work out where each result goes in a vertical layout, checking for
+ * overflow in the same way as the normal rendering loop. y is the position
+ * of the input, and the positions are stored in the render pool's row_y.
+ * Returns the number of rows.
+ */
+static size_t layout_rows(
+		struct entry *entry,
+		const cairo_font_extents_t *font_extents,
+		uint32_t num_results,
+		double y)
+{
+	struct render_pool *pool = &entry->harfbuzz.pool;
+	double pitch = font_extents->height + entry->result_spacing;
+	double clip_end = entry->clip_y + entry->clip_height;
+
+	if (pool->row_y_size < num_results) {
+		pool->row_y = xrealloc(pool->row_y, num_results * sizeof(*pool->row_y));
+		pool->row_y_size = num_results;
+	}
+
+	size_t num_rows;
+	for (num_rows = 0; num_rows < num_results; num_rows++) {
+		y += pitch;
+		if (num_rows + entry->first_result >= entry->results.count) {
+			break;
+		}
+		if (entry->num_results == 0) {
+			bool highlight = num_rows == entry->selection
+				&& entry->selection_highlight_color.a != 0;
+			if (y > clip_end) {
+				break;
+			}
+			if (!highlight && y + font_extents->height > clip_end) {
+				break;
+			}
+		}
+		pool->row_y[num_rows] = y;
+	}
+	return num_rows;
+}
+
+/*
+ * How far a row may draw above and below its position (the top of its line).
+ * That's the line itself plus its background box, assuming glyphs stay
+ * within the line, which they do for any sensible font.
+ */
+static void row_extents(
+		const struct entry *entry,
+		const cairo_font_extents_t *font_extents,
+		double *above,
+		double *below)
+{
+	int32_t pad_top = MAX(entry->default_result_theme.padding.top,
+			MAX(entry->alternate_result_theme.padding.top,
+				entry->selection_theme.padding.top));
+	int32_t pad_bottom = MAX(entry->default_result_theme.padding.bottom,
+			MAX(entry->alternate_result_theme.padding.bottom,
+				entry->selection_theme.padding.bottom));
+	*above = MAX(pad_top, 0);
+	*below = font_extents->height + MAX(pad_bottom, 0);
+}
+
+/*
+ * Try to render the results in parallel, returning false if we can't.
+ *
+ * This only works for vertical layouts, where the position of every result
+ * is known before drawing any of them. The window is split into horizontal
+ * bands, each drawn by a different thread with its own Cairo context over a
+ * disjoint slice of the buffer. Rows which straddle the boundary between two
+ * bands are drawn by both, each clipped to its own slice, so the end result
+ * is identical to drawing everything in one go.
+ */
+static bool render_results_threaded(
+		struct entry *entry,
+		const cairo_font_extents_t *font_extents,
+		uint32_t num_results)
+{
+	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
+	struct render_pool *pool = &hb->pool;
+
+	if (entry->horizontal || num_results < 2 * MIN_ROWS_PER_BAND) {
+		return false;
+	}
+
+	/*
+	 * Starting threads and loading extra copies of the font takes a few
+	 * milliseconds, so don't do it until the first frame is on screen.
+	 */
+	if (hb->num_frames == 0) {
+		return false;
+	}
+	if (!pool->started) {
+		render_pool_start(entry);
+	}
+	if (pool->num_threads < 2) {
+		return false;
+	}
+
+	double pitch = font_extents->height + entry->result_spacing;
+	if (pitch <= 0) {
+		return false;
+	}
+
+	cairo_t *cr = entry->cairo[entry->index].cr;
+	cairo_matrix_t mat;
+	cairo_get_matrix(cr, &mat);
+	size_t num_rows = layout_rows(entry, font_extents, num_results, mat.y0);
+
+	uint8_t num_bands = MIN(pool->num_threads, num_rows / MIN_ROWS_PER_BAND);
+	if (num_bands < 2) {
+		return false;
+	}
+
+	row_extents(entry, font_extents, &pool->extent_above, &pool->extent_below);
+	pool->row_x = mat.x0;
+	pool->num_rows = num_rows;
+
+	/* Split the rows evenly between bands. */
+	for (uint8_t b = 0; b < num_bands; b++) {
+		struct render_band *band = &pool->bands[b];
+		if (b == 0) {
+			band->y_start = 0;
+		} else {
+			band->y_start = floor(pool->row_y[b * num_rows / num_bands]);
+			band->y_start = MAX(band->y_start, 0);
+			pool->bands[b - 1].y_end = band->y_start;
+		}
+	}
+	pool->bands[num_bands - 1].y_end = entry->image.height;
+	for (uint8_t b = 0; b < num_bands; b++) {
+		if (pool->bands[b].y_start >= pool->bands[b].y_end) {
+			return false;
+		}
+	}
+
+	cairo_surface_t *surface = entry->cairo[entry->index].surface;
+	cairo_surface_flush(surface);
+
+	mtx_lock(&pool->lock);
+	pool->num_bands = num_bands;
+	pool->num_busy = num_bands - 1;
+	pool->generation++;
+	cnd_broadcast(&pool->start);
+	mtx_unlock(&pool->lock);
+
+	render_band(&pool->bands[0]);
+
+	mtx_lock(&pool->lock);
+	while (pool->num_busy > 0) {
+		cnd_wait(&pool->done, &pool->lock);
+	}
+	mtx_unlock(&pool->lock);
+
+	cairo_surface_mark_dirty(surface);
+
+	entry->num_results_drawn = num_rows;
+	log_debug("Drew %zu results in %hhu bands.\n", num_rows, num_bands);
+	return true;
+}
+
+void entry_backend_harfbuzz_init(
+		struct entry *entry,
+		uint32_t *width,
+		uint32_t *height)
+{
+	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
+	cairo_t *cr = entry->cairo[0].cr;
+	hb->font_size = floor(entry->font_size * PT_TO_DPI);
+
+	/*
+	 * Setting up our font has four main steps:
+	 *
+	 * 1. Map the font file into memory, and create a HarfBuzz face.
+	 * 2. Load the font face with FreeType from the mapped file.
+	 * 3. Create a HarfBuzz font from the HarfBuzz face.
+	 * 4. Create a Cairo font referencing the FreeType font.
+	 *
+	 * We use HarfBuzz to set font variation settings (such as weight), if
+	 * any. These then have to be copied over to the FreeType font, which
+	 * must happen before the Cairo font is created for the changes to
+	 * take effect.
+	 *
+	 * The last three steps are repeated for each render thread, if any
+	 * are started later on, so we parse our font settings up front.
+	 */
+
+	/* Setup FreeType. */
+	log_debug("Creating FreeType library.\n");
+	int err;
+	err = FT_Init_FreeType(&hb->ft_library);
+	if (err) {
+		log_error("Error initialising FreeType: %s\n",
+				get_ft_error_string(err));
+		exit(EXIT_FAILURE);
+	}
+
+	if (entry->font_variations[0] != 0) {
+		log_debug("Parsing font variations.\n");
+	}
+	char *saveptr = NULL;
+	char *variation = strtok_r(entry->font_variations, ",", &saveptr);
+	while (variation != NULL && hb->num_variations < N_ELEM(hb->hb_variations)) {
+		if (hb_variation_from_string(variation, -1, &hb->hb_variations[hb->num_variations])) {
+			hb->num_variations++;
+		} else {
+			log_error("Failed to parse font variation \"%s\".\n", variation);
+		}
+		variation = strtok_r(NULL, ",", &saveptr);
+	}
+
+	if (entry->font_features[0] != 0) {
+		log_debug("Parsing font features.\n");
+	}
+	saveptr = NULL;
+	char *feature = strtok_r(entry->font_features, ",", &saveptr);
+	while (feature != NULL && hb->num_features < N_ELEM(hb->hb_features)) {
+		if (hb_feature_from_string(feature, -1, &hb->hb_features[hb->num_features])) {
+			hb->num_features++;
+		} else {
+			log_error("Failed to parse font feature \"%s\".\n", feature);
+		}
+		feature = strtok_r(NULL, ",", &saveptr);
+	}
+
+	log_debug("Loading font.\n");
+	if (!font_file_init(&hb->files[0], entry->font_name)) {
+		exit(EXIT_FAILURE);
+	}
+	hb->num_files = 1;
+
+	/*
+	 * Map the fallback fonts up front too, so that render threads don't
+	 * each complain about the same missing file.
+	 */
+	saveptr = NULL;
+	char *fallback = strtok_r(entry->font_fallback, ",", &saveptr);
+	while (fallback != NULL && hb->num_files < N_ELEM(hb->files)) {
+		while (*fallback == ' ') {
+			fallback++;
+		}
+		if (font_file_init(&hb->files[hb->num_files], fallback)) {
+			hb->num_files++;
+		}
+		fallback = strtok_r(NULL, ",", &saveptr);
+	}
+
+	if (!harfbuzz_font_init(&hb->font, hb)) {
+		exit(EXIT_FAILURE);
+	}
+
+	struct color color = entry->foreground_color;
+	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+	set_cairo_font(cr, hb, &hb->font);
+
+	/* We also need to set up the font for our other Cairo context. */
+	set_cairo_font(entry->cairo[1].cr, hb, &hb->font);
+}
+
+void entry_backend_harfbuzz_destroy(struct entry *entry)
+{
+	render_pool_destroy(&entry->harfbuzz.pool);
+	free(entry->harfbuzz.last_frame.input);
+	free(entry->harfbuzz.last_frame.rows);
+	harfbuzz_font_destroy(&entry->harfbuzz.font);
+	FT_Done_FreeType(entry->harfbuzz.ft_library);
+	for (uint8_t i = 0; i < entry->harfbuzz.num_files; i++) {
+		font_file_destroy(&entry->harfbuzz.files[i]);
+	}
+}
+
+/*
+ * Render the prompt and the input (or placeholder) at the current origin,
+ * leaving the origin at the start of the input. Returns the extents of the
+ * input.
+ */
+static cairo_text_extents_t render_input(cairo_t *cr, struct entry *entry)
+{
+	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
+	cairo_text_extents_t extents;
+
+	/* Render the prompt */
+	extents = render_text_themed(cr, hb, &hb->font, entry->prompt_text, &entry->prompt_theme);
+
+	cairo_translate(cr, extents.x_advance, 0);
+	cairo_translate(cr, entry->prompt_padding, 0);
+
+	/* Render the entry text */
+	if (entry->input_utf8_length == 0) {
+		extents = render_text_themed(cr, hb, &hb->font, entry->placeholder_text, &entry->placeholder_theme);
+	} else if (entry->hide_input) {
+		/* The hidden character is at most 4 bytes, just like input. */
+		char buf[N_ELEM(entry->input_utf8) + 1];
+		size_t nchars = entry->input_utf32_length;
+		size_t char_size = entry->hidden_character_utf8_length;
+		for (size_t i = 0; i < nchars; i++) {
+			for (size_t j = 0; j < char_size; j++) {
+				buf[i * char_size + j] = entry->hidden_character_utf8[j];
+			}
+		}
+		buf[char_size * nchars] = '\0';
+
+		extents = render_text_themed(cr, hb, &hb->font, buf, &entry->input_theme);
+		render_cursor(cr, entry, buf);
+	} else {
+		extents = render_text_themed(cr, hb, &hb->font, entry->input_utf8, &entry->input_theme);
+		render_cursor(cr, entry, entry->input_utf8);
+	}
+	extents.x_advance = MAX(extents.x_advance, entry->input_width);
+	return extents;
+}
+
+/*
+ * Remember what was just drawn, for entry_backend_harfbuzz_update_rows().
+ * origin is where the prompt was drawn, and row_x is where the results
+ * start, both in device coordinates.
+ */
+static void record_frame(
+		struct entry *entry,
+		const cairo_matrix_t *origin,
+		double row_x,
+		size_t num_rows)
+{
+	struct last_frame *last = &entry->harfbuzz.last_frame;
+
+	if (entry->horizontal) {
+		last->valid = false;
+		return;
+	}
+
+	size_t size = strlen(entry->input_utf8) + 1;
+	if (last->input_size < size) {
+		last->input_size = MAX(size, 2 * last->input_size);
+		last->input = xrealloc(last->input, last->input_size);
+	}
+	memcpy(last->input, entry->input_utf8, size);
+
+	if (last->rows_size < num_rows) {
+		last->rows_size = MAX(num_rows, 2 * last->rows_size);
+		last->rows = xrealloc(last->rows, last->rows_size * sizeof(*last->rows));
+	}
+	for (size_t i = 0; i < num_rows; i++) {
+		last->rows[i] = entry->results.buf[entry->first_result + i].string;
+	}
+
+	last->origin_x = origin->x0;
+	last->origin_y = origin->y0;
+	last->row_x = row_x;
+	last->first_result = entry->first_result;
+	last->selection = entry->selection;
+	last->cursor_position = entry->cursor_position;
+	last->num_rows = num_rows;
+	last->valid = true;
+}
+
+/*
+ * Whether the row at new_pos in the frame about to be drawn looks the same as
+ * the one at old_pos in the last frame. Either may be past the end of the
+ * rows, in which case there's nothing there.
+ */
+static bool same_row(
+		const struct entry *entry,
+		size_t num_rows,
+		int64_t new_pos,
+		int64_t old_pos,
+		bool input_changed)
+{
+	const struct last_frame *last = &entry->harfbuzz.last_frame;
+	bool in_new = new_pos >= 0 && (size_t)new_pos < num_rows;
+	bool in_old = old_pos >= 0 && (size_t)old_pos < last->num_rows;
+	if (in_new != in_old) {
+		return false;
+	}
+	if (!in_new) {
+		return true;
+	}
+
+	bool selected = (uint32_t)new_pos == entry->selection;
+	if (selected != ((uint32_t)old_pos == last->selection)) {
+		return false;
+	}
+	if (selected && input_changed) {
+		/* Its match highlighting may have changed. */
+		return false;
+	}
+	if ((entry->first_result + new_pos) % 2 != (last->first_result + old_pos) % 2) {
+		/* It may need the other of the alternating themes. */
+		return false;
+	}
+	/*
+	 * The same string is always at the same address, and the odd
+	 * duplicate that isn't just gets redrawn.
+	 */
+	return entry->results.buf[entry->first_result + new_pos].string == last->rows[old_pos];
+}
+
+/*
+ * Add [start, end) to the list of regions to redraw, merging it with the last
+ * one if they touch. Regions must be added roughly in order. Returns false
+ * if there are too many.
+ */
+static bool add_region(
+		int32_t regions[][2],
+		size_t *num_regions,
+		double start,
+		double end,
+		int32_t min,
+		int32_t max)
+{
+	int32_t a = MAX(floor(start), min);
+	int32_t b = MIN(ceil(end), max);
+	if (a >= b) {
+		return true;
+	}
+	if (*num_regions > 0 && a <= regions[*num_regions - 1][1]) {
+		int32_t *last = regions[*num_regions - 1];
+		last[0] = MIN(last[0], a);
+		last[1] = MAX(last[1], b);
+		return true;
+	}
+	if (*num_regions == MAX_REDRAW_REGIONS) {
+		return false;
+	}
+	regions[*num_regions][0] = a;
+	regions[*num_regions][1] = b;
+	(*num_regions)++;
+	return true;
+}
+
+/*
+ * Try to draw the next frame by reusing the last one, returning false if it
+ * has to be drawn from scratch instead.
+ *
+ * Moving the selection or scrolling by a single row leaves almost all of the
+ * rows looking the same, just maybe one row up or down. Rather than shaping
+ * and drawing them all again, the rows are copied across from the last frame
+ * (which is in the other buffer), shifted by one row if we've scrolled, and
+ * only the regions around rows which have changed are cleared and redrawn.
+ *
+ * Rows can only be shifted by whole pixels, so this only works if the
+ * distance between them is a whole number of pixels, which it normally is
+ * with hinting. Otherwise, the shifted rows wouldn't quite match what
+ * drawing them from scratch would give.
+ */
+bool entry_backend_harfbuzz_update_rows(struct entry *entry)
+{
+	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
+	struct last_frame *last = &hb->last_frame;
+	cairo_t *cr = entry->cairo[entry->index].cr;
+
+	if (!last->valid || entry->horizontal) {
+		return false;
+	}
+
+	int64_t shift = (int64_t)entry->first_result - (int64_t)last->first_result;
+	if (shift < -1 || shift > 1) {
+		return false;
+	}
+
+	cairo_font_extents_t font_extents;
+	cairo_font_extents(cr, &font_extents);
+	double pitch = font_extents.height + entry->result_spacing;
+	if (pitch < 1 || pitch != floor(pitch)) {
+		return false;
+	}
+	int32_t step = pitch;
+
+	/*
+	 * The input is above the rows, and doesn't move. Its background box
+	 * (if any) ends by rows_top.
+	 */
+	int32_t input_pad = MAX(0, MAX(entry->prompt_theme.padding.bottom,
+			MAX(entry->input_theme.padding.bottom,
+				entry->placeholder_theme.padding.bottom)));
+	int32_t clip_top = entry->clip_y;
+	int32_t clip_end = entry->clip_y + entry->clip_height;
+	int32_t rows_top = ceil(last->origin_y + font_extents.height + input_pad);
+	if (rows_top + step > clip_end) {
+		return false;
+	}
+
+	uint32_t num_results;
+	if (entry->num_results == 0) {
+		num_results = entry->results.count;
 	} else {
 		num_results = MIN(entry->num_results, entry->results.count);
 	}
+	size_t num_rows = layout_rows(entry, &font_extents, num_results, last->origin_y);
+
+	double extent_above;
+	double extent_below;
+	row_extents(entry, &font_extents, &extent_above, &extent_below);
+
+	bool input_changed = entry->cursor_position != last->cursor_position
+		|| strcmp(entry->input_utf8, last->input) != 0;
+
+	/*
+	 * Work out what needs redrawing, in order from top to bottom. A
+	 * changed row means redrawing everything it covers, along with any
+	 * other rows which overlap that.
+	 */
+	int32_t regions[MAX_REDRAW_REGIONS][2];
+	size_t num_regions = 0;
+	bool ok = true;
+	if (input_changed) {
+		ok = add_region(regions, &num_regions, clip_top, rows_top, clip_top, clip_end);
+	} else if (shift != 0) {
+		/*
+		 * The input isn't shifted, so if the top row's background box
+		 * reaches up past it, that part has to be redrawn.
+		 */
+		double top = last->origin_y + pitch - extent_above;
+		ok = add_region(regions, &num_regions, top, rows_top, clip_top, clip_end);
+	}
+	if (shift < 0) {
+		/* Nothing to copy into the top row. */
+		ok = ok && add_region(regions, &num_regions, rows_top, rows_top + step, clip_top, clip_end);
+	}
+	int64_t start = MIN(0, -shift);
+	int64_t end = MAX((int64_t)num_rows, (int64_t)last->num_rows - shift);
+	for (int64_t k = start; k < end && ok; k++) {
+		if (same_row(entry, num_rows, k, k + shift, input_changed)) {
+			continue;
+		}
+		/*
+		 * A row scrolled off the top would be over the input, which
+		 * isn't shifted, so only what's below that needs clearing.
+		 */
+		double y = last->origin_y + (k + 1) * pitch;
+		int32_t min = k < 0 ? rows_top : clip_top;
+		ok = add_region(regions, &num_regions, y - extent_above, y + extent_below, min, clip_end);
+	}
+	if (shift > 0) {
+		/* Nothing to copy into the bottom row. */
+		ok = ok && add_region(regions, &num_regions, clip_end - step, clip_end, clip_top, clip_end);
+	}
+	if (!ok) {
+		return false;
+	}
+
+	/* Copy the last frame across, shifting the rows. */
+	cairo_surface_t *target = entry->cairo[entry->index].surface;
+	cairo_surface_t *source = entry->cairo[!entry->index].surface;
+	cairo_surface_flush(target);
+	cairo_surface_flush(source);
+	int stride = cairo_image_surface_get_stride(target);
+	unsigned char *dst = cairo_image_surface_get_data(target);
+	const unsigned char *src = cairo_image_surface_get_data(source);
+	size_t x = entry->clip_x * sizeof(uint32_t);
+	size_t width = entry->clip_width * sizeof(uint32_t);
+	for (int32_t y = clip_top; y < clip_end; y++) {
+		int64_t from = y < rows_top ? y : y + shift * step;
+		if (from < clip_top || from >= clip_end || (y >= rows_top && from < rows_top)) {
+			continue;
+		}
+		memcpy(&dst[y * stride + x], &src[from * stride + x], width);
+	}
+	cairo_surface_mark_dirty(target);
+
+	/* Then redraw whatever's changed. */
+	double *row_y = hb->pool.row_y;
+	for (size_t i = 0; i < num_regions; i++) {
+		int32_t a = regions[i][0];
+		int32_t b = regions[i][1];
+
+		cairo_save(cr);
+		cairo_identity_matrix(cr);
+		cairo_rectangle(cr, entry->clip_x, a, entry->clip_width, b - a);
+		cairo_clip(cr);
+
+		struct color color = entry->background_color;
+		cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+		cairo_paint(cr);
+		cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+		cairo_matrix_t mat;
+		if (a < rows_top) {
+			cairo_matrix_init_translate(&mat, last->origin_x, last->origin_y);
+			cairo_set_matrix(cr, &mat);
+			render_input(cr, entry);
+		}
+
+		color = entry->foreground_color;
+		cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+		for (size_t k = 0; k < num_rows; k++) {
+			if (row_y[k] + extent_below <= a) {
+				continue;
+			}
+			if (row_y[k] - extent_above >= b) {
+				break;
+			}
+			cairo_matrix_init_translate(&mat, last->row_x, row_y[k]);
+			cairo_set_matrix(cr, &mat);
+			render_result(cr, entry, &hb->font, k, entry->first_result + k);
+		}
+		cairo_restore(cr);
+	}
+
+	/*
+	 * When the rows have moved, all of them have changed as far as the
+	 * compositor's concerned.
+	 */
+	int32_t damage_start = shift != 0 ? rows_top : clip_end;
+	int32_t damage_end = shift != 0 ? clip_end : clip_top;
+	for (size_t i = 0; i < num_regions; i++) {
+		damage_start = MIN(damage_start, regions[i][0]);
+		damage_end = MAX(damage_end, regions[i][1]);
+	}
+	entry->image.damage.x = entry->clip_x;
+	entry->image.damage.y = damage_start;
+	entry->image.damage.width = entry->clip_width;
+	entry->image.damage.height = MAX(damage_end - damage_start, 0);
+
+	cairo_matrix_t origin;
+	cairo_matrix_init_translate(&origin, last->origin_x, last->origin_y);
+	record_frame(entry, &origin, last->row_x, num_rows);
+	entry->num_results_drawn = num_rows;
+	hb->num_frames++;
+	log_debug("Scrolled by %" PRId64 " rows, redrawing %zu regions.\n", shift, num_regions);
+	return true;
+}
+
+void entry_backend_harfbuzz_update(struct entry *entry)
+{
+	struct entry_backend_harfbuzz *hb = &entry->harfbuzz;
+	cairo_t *cr = entry->cairo[entry->index].cr;
+	cairo_text_extents_t extents;
+
+	cairo_save(cr);
+
+	cairo_matrix_t origin;
+	cairo_get_matrix(cr, &origin);
+	extents = render_input(cr, entry);
+
+	cairo_matrix_t mat;
+	cairo_get_matrix(cr, &mat);
+	double row_x = mat.x0;
+
+	cairo_font_extents_t font_extents;
+	cairo_font_extents(cr, &font_extents);
+
+	uint32_t num_results;
+	if (entry->num_results == 0) {
+		num_results = entry->results.count;
+	} else {
+		num_results = MIN(entry->num_results, entry->results.count);
+	}
+
+	if (render_results_threaded(entry, &font_extents, num_results)) {
+		record_frame(entry, &origin, row_x, entry->num_results_drawn);
+		hb->num_frames++;
+		cairo_restore(cr);
+		return;
+	}
+
 	/* Render our results */
 	size_t i;
 	for (i = 0; i < num_results; i++) {
@@ -419,195 +1623,59 @@ void entry_backend_harfbuzz_update(struct entry *entry)
 			break;
 		}
 
-		const char *result = entry->results.buf[index].string;
 		/*
-		 * If this isn't the selected result, or it is but we're not
-		 * doing any fancy match-highlighting, just print as normal.
+		 * N.B. The size_overflows check isn't necessary for a
+		 * highlighted selection, as it's currently not possible for
+		 * the selection to do so.
 		 */
-		if (i != entry->selection || (entry->selection_highlight_color.a == 0)) {
-			const struct text_theme *theme;
-			if (i == entry->selection) {
-				theme = &entry->selection_theme;
-			} else if (index % 2) {
-				theme = &entry->alternate_result_theme;;
-			} else {
-				theme = &entry->default_result_theme;;
-			}
-
-			if (entry->num_results > 0) {
-				/*
-				 * We're not auto-detecting how many results we
-				 * can fit, so just render the text.
-				 */
-				extents = render_text_themed(cr, &entry->harfbuzz, result, theme);
-			} else if (!entry->horizontal) {
-				/*
-				 * The height of the text doesn't change, so
-				 * we don't need to re-measure it each time.
-				 */
-				if (size_overflows(entry, 0, font_extents.height)) {
-					entry->num_results_drawn = i;
-					break;
-				} else {
-					extents = render_text_themed(cr, &entry->harfbuzz, result, theme);
-				}
+		bool highlight = i == entry->selection
+			&& entry->selection_highlight_color.a != 0;
+		if (highlight || entry->num_results > 0) {
+			/*
+			 * We're not auto-detecting how many results we can
+			 * fit, so just render the text.
+			 */
+			extents = render_result(cr, entry, &hb->font, i, index);
+		} else if (!entry->horizontal) {
+			/*
+			 * The height of the text doesn't change, so we don't
+			 * need to re-measure it each time.
+			 */
+			if (size_overflows(entry, 0, font_extents.height)) {
+				entry->num_results_drawn = i;
+				break;
 			} else {
-				/*
-				 * The difficult case: we're auto-detecting how
-				 * many results to draw, but we can't know
-				 * whether this result will fit without
-				 * drawing it! To solve this, draw to a
-				 * temporary group, measure that, then copy it
-				 * to the main canvas only if it will fit.
-				 */
-				cairo_push_group(cr);
-				extents = render_text_themed(cr, &entry->harfbuzz, result, theme);
-
-				cairo_pattern_t *group = cairo_pop_group(cr);
-				if (size_overflows(entry, extents.x_advance, 0)) {
-					entry->num_results_drawn = i;
-					cairo_pattern_destroy(group);
-					break;
-				} else {
-					cairo_save(cr);
-					cairo_set_source(cr, group);
-					cairo_paint(cr);
-					cairo_restore(cr);
-					cairo_pattern_destroy(group);
-				}
+				extents = render_result(cr, entry, &hb->font, i, index);
 			}
 		} else {
 			/*
-			 * For match highlighting, there's a bit more to do.
-			 *
-			 * We need to split the text into prematch, match and
-			 * postmatch chunks, and draw each separately.
-			 *
-			 * However, we only want one background box around them
-			 * all (if we're drawing one). To do this, we have to
-			 * do the rendering part of render_text_themed()
-			 * manually, with the same method of:
-			 * - Draw the text and measure it
-			 * - Draw the box
-			 * - Draw the text again
-			 *
-			 * N.B. The size_overflows check isn't necessary here,
-			 * as it's currently not possible for the selection to
-			 * do so.
+			 * The difficult case: we're auto-detecting how many
+			 * results to draw, but we can't know whether this
+			 * result will fit without drawing it! To solve this,
+			 * draw to a temporary group, measure that, then copy
+			 * it to the main canvas only if it will fit.
 			 */
-			size_t prematch_len;
-			size_t postmatch_len;
-			char *prematch = xstrdup(result);
-			char *match = NULL;
-			char *postmatch = NULL;
-			if (entry->input_utf8_length > 0 && entry->selection_highlight_color.a != 0) {
-				char *match_pos = utf8_strcasestr(prematch, entry->input_utf8);
-				if (match_pos != NULL) {
-					match = xstrdup(result);
-					prematch_len = (match_pos - prematch);
-					prematch[prematch_len] = '\0';
-					postmatch_len = strlen(result) - prematch_len - entry->input_utf8_length;
-					if (postmatch_len > 0) {
-						postmatch = xstrdup(result);
-					}
-					match[entry->input_utf8_length + prematch_len] = '\0';
-				}
-			}
+			cairo_push_group(cr);
+			extents = render_result(cr, entry, &hb->font, i, index);
 
-			for (int pass = 0; pass < 2; pass++) {
+			cairo_pattern_t *group = cairo_pop_group(cr);
+			if (size_overflows(entry, extents.x_advance, 0)) {
+				entry->num_results_drawn = i;
+				cairo_pattern_destroy(group);
+				break;
+			} else {
 				cairo_save(cr);
-				struct color color = entry->selection_theme.foreground_color;
-				cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-
-				cairo_text_extents_t subextents = render_text(cr, &entry->harfbuzz, prematch);
-				extents = subextents;
-
-				if (match != NULL) {
-					cairo_translate(cr, subextents.x_advance, 0);
-					color = entry->selection_highlight_color;
-					cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-
-					subextents = render_text(cr, &entry->harfbuzz, &match[prematch_len]);
-
-					if (prematch_len == 0) {
-						extents = subextents;
-					} else {
-						/*
-						 * This calculation is a little
-						 * complex, but it's basically:
-						 *
-						 * (distance from leftmost pixel of
-						 * prematch to logical end of prematch)
-						 * 
-						 * +
-						 *
-						 * (distance from logical start of match
-						 * to rightmost pixel of match).
-						 */
-						extents.width = extents.x_advance
-							- extents.x_bearing
-							+ subextents.x_bearing
-							+ subextents.width;
-						extents.x_advance += subextents.x_advance;
-					}
-				}
-
-				if (postmatch != NULL) {
-					cairo_translate(cr, subextents.x_advance, 0);
-					color = entry->selection_theme.foreground_color;
-					cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-					subextents = render_text(
-							cr,
-							&entry->harfbuzz,
-							&postmatch[entry->input_utf8_length + prematch_len]);
-
-					extents.width = extents.x_advance
-						- extents.x_bearing
-						+ subextents.x_bearing
-						+ subextents.width;
-					extents.x_advance += subextents.x_advance;
-				}
-
+				cairo_set_source(cr, group);
+				cairo_paint(cr);
 				cairo_restore(cr);
-
-				if (entry->selection_theme.background_color.a == 0) {
-					/* No background box, we're done. */
-					break;
-				} else if (pass == 0) {
-					/* 
-					 * First pass, paint over the text with
-					 * our background box.
-					 */
-					struct directional padding = entry->selection_theme.padding;
-					cairo_save(cr);
-					color = entry->selection_theme.background_color;
-					cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-					cairo_translate(
-							cr,
-							floor(-padding.left + extents.x_bearing),
-							-padding.top);
-					rounded_rectangle(
-							cr,
-							ceil(extents.width + padding.left + padding.right),
-							ceil(font_extents.height + padding.top + padding.bottom),
-							entry->selection_theme.background_corner_radius
-							);
-					cairo_fill(cr);
-					cairo_restore(cr);
-				}
-			}
-
-			free(prematch);
-			if (match != NULL) {
-				free(match);
-			}
-			if (postmatch != NULL) {
-				free(postmatch);
+				cairo_pattern_destroy(group);
 			}
 		}
 	}
 	entry->num_results_drawn = i;
 	log_debug("Drew %zu results.\n", i);
 
+	record_frame(entry, &origin, row_x, i);
+	hb->num_frames++;
 	cairo_restore(cr);
 }
@@ -2,6 +2,7 @@
 #define ENTRY_BACKEND_HARFBUZZ_H
 
 #include <stdbool.h>
+#include <threads.h>
 #include <cairo/cairo-ft.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -9,27 +10,175 @@
 
 #define MAX_FONT_VARIATIONS 16
 #define MAX_FONT_FEATURES 16
+#define MAX_FONT_FALLBACKS 8
+#define MAX_RENDER_THREADS 8
+
+/* Must be a power of two. */
+#define COVERAGE_CACHE_SIZE 256
 
 struct entry;
 
-struct entry_backend_harfbuzz {
-	FT_Library ft_library;
-	FT_Face ft_face;
+/*
+ * A font file, mapped into memory once and shared between all threads.
+ * HarfBuzz faces are immutable, so can be shared too, but FreeType faces
+ * can't, so each thread creates its own from the mapped data.
+ */
+struct font_file {
+	const char *filename;
+	hb_blob_t *blob;
+	hb_face_t *hb_face;
+};
 
+/*
+ * A single font file, loaded for use by one thread.
+ */
+struct harfbuzz_face {
+	FT_Face ft_face;
 	cairo_font_face_t *cairo_face;
-
 	hb_font_t *hb_font;
+};
+
+/*
+ * Which face a codepoint was last drawn with. A codepoint of 0 marks an empty
+ * slot, as it never appears in text.
+ */
+struct coverage_entry {
+	uint32_t codepoint;
+	uint8_t face;
+};
+
+/*
+ * Everything needed to shape and draw text from a single thread.
+ *
+ * FreeType faces mustn't be used from more than one thread at a time, and
+ * both HarfBuzz and Cairo call into FreeType, so each render thread gets its
+ * own copy of these.
+ *
+ * faces[0] is the main font, and the rest are fallbacks, tried in order for
+ * any characters it's missing.
+ */
+struct harfbuzz_font {
+	struct harfbuzz_face faces[1 + MAX_FONT_FALLBACKS];
+	uint8_t num_faces;
 	hb_buffer_t *hb_buffer;
+	struct coverage_entry coverage[COVERAGE_CACHE_SIZE];
+
+	/*
+	 * Scratch space for converting shaped glyphs for Cairo, which only
+	 * grows, so that drawing doesn't allocate once it's big enough.
+	 */
+	cairo_glyph_t *cairo_glyphs;
+	unsigned int cairo_glyphs_size;
+};
+
+/*
+ * A Cairo context drawing to rows [y_start, y_end) of one of the entry's
+ * buffers.
+ */
+struct band_context {
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	int32_t y_start;
+	int32_t y_end;
+};
+
+/*
+ * A horizontal slice of the window, rendered independently of the others.
+ */
+struct render_band {
+	struct entry *entry;
+	struct harfbuzz_font font;
+	thrd_t thread;
+
+	/* The last frame this band was asked to draw, guarded by the pool's lock. */
+	uint32_t generation;
+
+	/* The rows of the buffer covered by this band, [y_start, y_end). */
+	int32_t y_start;
+	int32_t y_end;
+
+	/*
+	 * A Cairo context for each of the entry's two buffers, kept between
+	 * frames as long as the band's slice doesn't change.
+	 */
+	struct band_context cairo[2];
+};
+
+struct render_pool {
+	mtx_t lock;
+	cnd_t start;
+	cnd_t done;
+	uint32_t generation;
+	uint8_t num_busy;
+	uint8_t num_threads;
+	bool started;
+	bool quit;
+
+	/* Band 0 is always drawn by the main thread. */
+	struct render_band bands[MAX_RENDER_THREADS];
+	uint8_t num_bands;
+
+	/*
+	 * Layout of the current frame, shared by all bands. Positions are in
+	 * device coordinates, and extents are how far a row may draw
+	 * above and below its position.
+	 */
+	double row_x;
+	double *row_y;
+	size_t row_y_size;
+	size_t num_rows;
+	double extent_above;
+	double extent_below;
+};
+
+/*
+ * What the last frame drawn looked like, so that the next one can be drawn
+ * from it if not much has changed. Positions are in device coordinates.
+ *
+ * input is a copy of the input, but rows just points at each row's string,
+ * which stays put as long as the candidates do. Whoever replaces the
+ * candidates must clear valid first.
+ */
+struct last_frame {
+	bool valid;
+	double origin_x;
+	double origin_y;
+	double row_x;
+	uint32_t first_result;
+	uint32_t selection;
+	uint32_t cursor_position;
+	size_t num_rows;
+
+	char *input;
+	size_t input_size;
+	const char **rows;
+	size_t rows_size;
+};
+
+struct entry_backend_harfbuzz {
+	FT_Library ft_library;
+	struct harfbuzz_font font;
+
 	hb_variation_t hb_variations[MAX_FONT_VARIATIONS];
 	hb_feature_t hb_features[MAX_FONT_FEATURES];
 	uint8_t num_variations;
 	uint8_t num_features;
 
+	/* The main font, followed by any fallbacks. */
+	struct font_file files[1 + MAX_FONT_FALLBACKS];
+	uint8_t num_files;
+
+	uint32_t font_size;
 	bool disable_hinting;
+	uint32_t num_frames;
+
+	struct render_pool pool;
+	struct last_frame last_frame;
 };
 
 void entry_backend_harfbuzz_init(struct entry *entry, uint32_t *width, uint32_t *height);
 void entry_backend_harfbuzz_destroy(struct entry *entry);
 void entry_backend_harfbuzz_update(struct entry *entry);
+bool entry_backend_harfbuzz_update_rows(struct entry *entry);
 
 #endif /* ENTRY_BACKEND_HARFBUZZ_H */
@@ -5,7 +5,6 @@
 #include "../log.h"
 #include "../nelem.h"
 #include "../unicode.h"
-#include "../xmalloc.h"
 
 #undef MAX
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -13,25 +12,6 @@
 #undef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
-static void rounded_rectangle(cairo_t *cr, uint32_t width, uint32_t height, uint32_t r)
-{
-	cairo_new_path(cr);
-
-	/* Top-left */
-	cairo_arc(cr, r, r, r, -M_PI, -M_PI_2);
-
-	/* Top-right */
-	cairo_arc(cr, width - r, r, r, -M_PI_2, 0);
-
-	/* Bottom-right */
-	cairo_arc(cr, width - r, height - r, r, 0, M_PI_2);
-
-	/* Bottom-left */
-	cairo_arc(cr, r, height - r, r, M_PI_2, M_PI);
-
-	cairo_close_path(cr);
-}
-
 static void render_text_themed(
 		cairo_t *cr,
 		PangoLayout *layout,
@@ -57,19 +37,16 @@ static void render_text_themed(
 	struct directional padding = theme->padding;
 
 	cairo_save(cr);
-	color = theme->background_color;
-	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
 	cairo_translate(
 			cr,
 			floor(-padding.left + ink_rect->x),
 			-padding.top);
-	rounded_rectangle(
+	nine_patch_draw(
 			cr,
+			&theme->background_patch,
 			ceil(ink_rect->width + padding.left + padding.right),
-			ceil(logical_rect->height + padding.top + padding.bottom),
-			theme->background_corner_radius
+			ceil(logical_rect->height + padding.top + padding.bottom)
 			);
-	cairo_fill(cr);
 	cairo_restore(cr);
 
 	color = theme->foreground_color;
@@ -136,6 +113,31 @@ static bool size_overflows(struct entry *entry, uint32_t width, uint32_t height)
 	return false;
 }
 
+/*
+ * Draw the text cursor in front of the character at cursor_position in the
+ * input text, which must be what's in the layout. As in the harfbuzz backend,
+ * it's only drawn once it's been moved away from the end.
+ */
+static void render_cursor(cairo_t *cr, struct entry *entry, const char *text)
+{
+	if (entry->cursor_position >= entry->input_utf32_length) {
+		return;
+	}
+
+	const char *end = text;
+	for (uint32_t i = 0; i < entry->cursor_position && *end != '\0'; i++) {
+		end = utf8_next_char(end);
+	}
+	PangoRectangle pos;
+	pango_layout_index_to_pos(entry->pango.layout, end - text, &pos);
+
+	double height = (double)pos.height / PANGO_SCALE;
+	struct color color = entry->input_theme.foreground_color;
+	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+	cairo_rectangle(cr, round((double)pos.x / PANGO_SCALE), 0, ceil(height / 16), height);
+	cairo_fill(cr);
+}
+
 /*
  * This is pretty much a direct translation of the corresponding function in
  * the harfbuzz backend. As that's the one that I care about most, there are
@@ -162,9 +164,9 @@ void entry_backend_pango_update(struct entry *entry)
 	if (entry->input_utf8_length == 0) {
 		render_text_themed(cr, layout, entry->placeholder_text, &entry->placeholder_theme, &ink_rect, &logical_rect);
 	} else if (entry->hide_input) {
+		char buf[N_ELEM(entry->input_utf8) + 1];
 		size_t nchars = entry->input_utf32_length;
 		size_t char_size = entry->hidden_character_utf8_length;
-		char *buf = xmalloc(1 + nchars * char_size);
 		for (size_t i = 0; i < nchars; i++) {
 			for (size_t j = 0; j < char_size; j++) {
 				buf[i * char_size + j] = entry->hidden_character_utf8[j];
@@ -173,9 +175,10 @@ void entry_backend_pango_update(struct entry *entry)
 		buf[char_size * nchars] = '\0';
 
 		render_text_themed(cr, layout, buf, &entry->placeholder_theme, &ink_rect, &logical_rect);
-		free(buf);
+		render_cursor(cr, entry, buf);
 	} else {
 		render_text_themed(cr, layout, entry->input_utf8, &entry->input_theme, &ink_rect, &logical_rect);
+		render_cursor(cr, entry, entry->input_utf8);
 	}
 	logical_rect.width = MAX(logical_rect.width, (int)entry->input_width);
 
@@ -326,19 +329,16 @@ void entry_backend_pango_update(struct entry *entry)
 				} else if (pass == 0) {
 					struct directional padding = entry->selection_theme.padding;
 					cairo_save(cr);
-					color = entry->selection_theme.background_color;
-					cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
 					cairo_translate(
 							cr,
 							floor(-padding.left + ink_rect.x),
 							-padding.top);
-					rounded_rectangle(
+					nine_patch_draw(
 							cr,
+							&entry->selection_theme.background_patch,
 							ceil(ink_rect.width + padding.left + padding.right),
-							ceil(logical_rect.height + padding.top + padding.bottom),
-							entry->selection_theme.background_corner_radius
+							ceil(logical_rect.height + padding.top + padding.bottom)
 							);
-					cairo_fill(cr);
 					cairo_restore(cr);
 				}
 			}
@@ -0,0 +1,242 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "filter_thread.h"
+#include "log.h"
+#include "query.h"
+
+/*
+ * Work out the results for one request. If the last query and this one are
+ * both plain words, and this one just adds to the end of the last one, its
+ * results must be a subset of the last results, so only those need looking
+ * at. This is the same trick as add_character() in input.c. Otherwise, any
+ * words that haven't changed can use their cached scores.
+ */
+static struct string_ref_vec run_filter(
+		struct filter_thread *filter,
+		const struct string_ref_vec *source,
+		const char *input,
+		bool fuzzy_match,
+		bool path_match)
+{
+	struct query query = query_compile(input, fuzzy_match, path_match);
+	size_t base_len = strlen(filter->base_input);
+	bool narrow = filter->base_valid
+		&& query.plain
+		&& strncmp(input, filter->base_input, base_len) == 0;
+
+	struct string_ref_vec results;
+	if (narrow) {
+		results = string_ref_vec_filter(&filter->base, &query);
+	} else {
+		results = group_cache_filter(&filter->groups, source, &query);
+	}
+
+	if (filter->base_valid) {
+		string_ref_vec_destroy(&filter->base);
+	}
+	filter->base_valid = query.plain;
+	if (query.plain) {
+		filter->base = string_ref_vec_copy(&results);
+	}
+	snprintf(filter->base_input, sizeof(filter->base_input), "%s", input);
+
+	query_destroy(&query);
+	return results;
+}
+
+static int filter_thread_run(void *arg)
+{
+	struct filter_thread *filter = arg;
+	char input[sizeof(filter->input)];
+
+	mtx_lock(&filter->lock);
+	while (true) {
+		while (!filter->pending && !filter->quit) {
+			cnd_wait(&filter->cond, &filter->lock);
+		}
+		if (filter->quit) {
+			break;
+		}
+		if (filter->forget) {
+			if (filter->base_valid) {
+				string_ref_vec_destroy(&filter->base);
+				filter->base_valid = false;
+			}
+			group_cache_reset(&filter->groups);
+			filter->forget = false;
+		}
+		const struct string_ref_vec *source = filter->source;
+		bool fuzzy_match = filter->fuzzy_match;
+		bool path_match = filter->path_match;
+		uint32_t version = filter->requested;
+		memcpy(input, filter->input, sizeof(input));
+		filter->pending = false;
+		filter->running = true;
+		mtx_unlock(&filter->lock);
+
+		struct string_ref_vec results = run_filter(filter, source, input, fuzzy_match, path_match);
+
+		mtx_lock(&filter->lock);
+		if (filter->ready) {
+			/* Nobody took the last results, so they're out of date. */
+			string_ref_vec_destroy(&filter->results);
+		}
+		filter->results = results;
+		filter->completed = version;
+		filter->ready = true;
+		filter->running = false;
+		cnd_broadcast(&filter->cond);
+
+		uint64_t done = 1;
+		if (write(filter->fd, &done, sizeof(done)) != sizeof(done)) {
+			log_error("Failed to signal filtered results: %s\n", strerror(errno));
+		}
+	}
+	mtx_unlock(&filter->lock);
+	return 0;
+}
+
+void filter_thread_start(struct filter_thread *filter)
+{
+	errno = 0;
+	filter->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (filter->fd == -1) {
+		log_error("Failed to create eventfd: %s\n", strerror(errno));
+		return;
+	}
+	mtx_init(&filter->lock, mtx_plain);
+	cnd_init(&filter->cond);
+	if (thrd_create(&filter->thread, filter_thread_run, filter) != thrd_success) {
+		log_error("Failed to start filter thread.\n");
+		mtx_destroy(&filter->lock);
+		cnd_destroy(&filter->cond);
+		close(filter->fd);
+		filter->fd = -1;
+		return;
+	}
+	filter->started = true;
+}
+
+void filter_thread_destroy(struct filter_thread *filter)
+{
+	if (!filter->started) {
+		return;
+	}
+	mtx_lock(&filter->lock);
+	filter->quit = true;
+	cnd_broadcast(&filter->cond);
+	mtx_unlock(&filter->lock);
+	thrd_join(filter->thread, NULL);
+
+	if (filter->ready) {
+		string_ref_vec_destroy(&filter->results);
+	}
+	if (filter->base_valid) {
+		string_ref_vec_destroy(&filter->base);
+	}
+	group_cache_reset(&filter->groups);
+	mtx_destroy(&filter->lock);
+	cnd_destroy(&filter->cond);
+	close(filter->fd);
+	filter->started = false;
+}
+
+/*
+ * Ask for source to be filtered by input. source must be left alone until
+ * the results have been taken, or filter_thread_forget() has been called.
+ */
+void filter_thread_request(
+		struct filter_thread *filter,
+		const struct string_ref_vec *source,
+		const char *input,
+		bool fuzzy_match,
+		bool path_match)
+{
+	mtx_lock(&filter->lock);
+	filter->source = source;
+	snprintf(filter->input, sizeof(filter->input), "%s", input);
+	filter->fuzzy_match = fuzzy_match;
+	filter->path_match = path_match;
+	filter->requested++;
+	filter->pending = true;
+	cnd_broadcast(&filter->cond);
+	mtx_unlock(&filter->lock);
+}
+
+/*
+ * Return whether there's a request whose results haven't been taken yet.
+ * Only the main thread changes either version, so there's no need to lock.
+ */
+bool filter_thread_busy(const struct filter_thread *filter)
+{
+	return filter->started && filter->requested != filter->taken;
+}
+
+/*
+ * If there are new results, hand them over and return true, otherwise
+ * return false without waiting.
+ */
+bool filter_thread_take(struct filter_thread *filter, struct string_ref_vec *results)
+{
+	if (!filter->started) {
+		return false;
+	}
+	uint64_t count;
+	if (read(filter->fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+		log_error("Failed to read filter eventfd: %s\n", strerror(errno));
+	}
+
+	bool taken = false;
+	mtx_lock(&filter->lock);
+	if (filter->ready) {
+		*results = filter->results;
+		filter->ready = false;
+		filter->taken = filter->completed;
+		taken = true;
+	}
+	mtx_unlock(&filter->lock);
+	return taken;
+}
+
+/*
+ * Wait for the newest request to finish, then take its results as with
+ * filter_thread_take(). This is for when we can't carry on without the
+ * up-to-date results, e.g. to submit the selected one.
+ */
+bool filter_thread_wait(struct filter_thread *filter, struct string_ref_vec *results)
+{
+	if (!filter->started) {
+		return false;
+	}
+	mtx_lock(&filter->lock);
+	while (filter->pending || filter->running) {
+		cnd_wait(&filter->cond, &filter->lock);
+	}
+	mtx_unlock(&filter->lock);
+	return filter_thread_take(filter, results);
+}
+
+/*
+ * Wait for the thread to be idle, and throw away anything it's remembered
+ * about the current source, which is about to change.
+ */
+void filter_thread_forget(struct filter_thread *filter)
+{
+	if (!filter->started) {
+		return;
+	}
+	mtx_lock(&filter->lock);
+	while (filter->pending || filter->running) {
+		cnd_wait(&filter->cond, &filter->lock);
+	}
+	filter->forget = true;
+	if (filter->ready) {
+		string_ref_vec_destroy(&filter->results);
+		filter->ready = false;
+	}
+	filter->taken = filter->requested;
+	mtx_unlock(&filter->lock);
+}
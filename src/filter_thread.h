@@ -0,0 +1,78 @@
+#ifndef FILTER_THREAD_H
+#define FILTER_THREAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <threads.h>
+#include "entry.h"
+#include "group_cache.h"
+#include "string_vec.h"
+
+/*
+ * Below this many candidates, filtering is quick enough that handing it off
+ * to another thread would only add latency.
+ */
+#define FILTER_THREAD_MIN_CANDIDATES 8192
+
+/*
+ * Filters the candidates on a separate thread, so that the main thread can
+ * carry on drawing the previous results (and the new input) while the next
+ * ones are worked out. When typing quickly, filtering and drawing then
+ * overlap, rather than happening one after the other for each keystroke.
+ *
+ * Only the newest request matters, so a request replaces any that hasn't
+ * been started yet. Each set of results is tagged with the version of the
+ * request it's for, and fd is signalled whenever a new set is ready.
+ */
+struct filter_thread {
+	thrd_t thread;
+	mtx_t lock;
+	cnd_t cond;
+	int fd;
+	bool started;
+	bool quit;
+
+	/* The newest request, guarded by lock. */
+	const struct string_ref_vec *source;
+	char input[4 * MAX_INPUT_LENGTH + 1];
+	bool fuzzy_match;
+	bool path_match;
+	uint32_t requested;
+	bool pending;
+	bool running;
+	bool forget;
+
+	/* The newest results, guarded by lock. */
+	struct string_ref_vec results;
+	uint32_t completed;
+	bool ready;
+
+	/* The last version handed over with filter_thread_take(). */
+	uint32_t taken;
+
+	/*
+	 * The filter thread's own copy of its last results, which the next
+	 * request can narrow down if it just adds to the input.
+	 */
+	struct string_ref_vec base;
+	char base_input[4 * MAX_INPUT_LENGTH + 1];
+	bool base_valid;
+
+	/* The filter thread's own per-word scores, for other edits. */
+	struct group_cache groups;
+};
+
+void filter_thread_start(struct filter_thread *filter);
+void filter_thread_destroy(struct filter_thread *filter);
+void filter_thread_request(
+		struct filter_thread *filter,
+		const struct string_ref_vec *source,
+		const char *input,
+		bool fuzzy_match,
+		bool path_match);
+bool filter_thread_busy(const struct filter_thread *filter);
+bool filter_thread_take(struct filter_thread *filter, struct string_ref_vec *results);
+bool filter_thread_wait(struct filter_thread *filter, struct string_ref_vec *results);
+void filter_thread_forget(struct filter_thread *filter);
+
+#endif /* FILTER_THREAD_H */
@@ -0,0 +1,274 @@
+#include <string.h>
+#include "front_code.h"
+#include "log.h"
+#include "xmalloc.h"
+
+static const char magic[8] = "tofi-fc1";
+
+#define HEADER_SIZE (sizeof(magic) + 4 * sizeof(uint32_t))
+
+static void put_u32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = value;
+	buf[1] = value >> 8;
+	buf[2] = value >> 16;
+	buf[3] = value >> 24;
+}
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+	return (uint32_t)buf[0]
+		| (uint32_t)buf[1] << 8
+		| (uint32_t)buf[2] << 16
+		| (uint32_t)buf[3] << 24;
+}
+
+static size_t put_varint(uint8_t *buf, uint32_t value)
+{
+	size_t n = 0;
+	while (value >= 0x80) {
+		buf[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	buf[n++] = value;
+	return n;
+}
+
+/*
+ * Read a varint from buf into value, returning the number of bytes used, or
+ * 0 if it runs past end.
+ */
+static size_t get_varint(const uint8_t *buf, const uint8_t *end, uint32_t *value)
+{
+	*value = 0;
+	for (size_t n = 0; n < 5 && buf + n < end; n++) {
+		*value |= (uint32_t)(buf[n] & 0x7F) << (7 * n);
+		if (!(buf[n] & 0x80)) {
+			return n + 1;
+		}
+	}
+	return 0;
+}
+
+uint8_t *front_code_encode(const char *buffer, size_t *size)
+{
+	/*
+	 * Count the strings first, so we know how many restart points there
+	 * will be. The entries can't be any bigger than the input plus a few
+	 * bytes of lengths each, so that's a safe upper bound to allocate.
+	 */
+	size_t count = 0;
+	size_t len = strlen(buffer);
+	for (const char *c = buffer; *c != '\0'; c++) {
+		if (*c == '\n') {
+			count++;
+		}
+	}
+	if (len > 0 && buffer[len - 1] != '\n') {
+		count++;
+	}
+	size_t num_restarts = (count + FRONT_CODE_RESTART_INTERVAL - 1) / FRONT_CODE_RESTART_INTERVAL;
+	size_t restarts_size = num_restarts * sizeof(uint32_t);
+
+	uint8_t *data = xmalloc(HEADER_SIZE + restarts_size + len + 10 * count + 1);
+	uint8_t *restarts = data + HEADER_SIZE;
+	uint8_t *entries = restarts + restarts_size;
+
+	size_t pos = 0;
+	size_t decoded_size = 0;
+	const char *prev = NULL;
+	size_t prev_len = 0;
+	const char *str = buffer;
+	for (size_t i = 0; i < count; i++) {
+		const char *newline = strchr(str, '\n');
+		size_t str_len = newline ? (size_t)(newline - str) : strlen(str);
+
+		size_t shared = 0;
+		if (i % FRONT_CODE_RESTART_INTERVAL == 0) {
+			put_u32(&restarts[4 * (i / FRONT_CODE_RESTART_INTERVAL)], pos);
+		} else {
+			while (shared < prev_len && shared < str_len && prev[shared] == str[shared]) {
+				shared++;
+			}
+		}
+		pos += put_varint(&entries[pos], shared);
+		pos += put_varint(&entries[pos], str_len - shared);
+		memcpy(&entries[pos], &str[shared], str_len - shared);
+		pos += str_len - shared;
+		decoded_size += str_len + 1;
+
+		prev = str;
+		prev_len = str_len;
+		str += str_len + 1;
+	}
+
+	memcpy(data, magic, sizeof(magic));
+	put_u32(&data[sizeof(magic)], count);
+	put_u32(&data[sizeof(magic) + 4], num_restarts);
+	put_u32(&data[sizeof(magic) + 8], decoded_size);
+	put_u32(&data[sizeof(magic) + 12], pos);
+
+	*size = HEADER_SIZE + restarts_size + pos;
+	log_debug("Front coded %zu bytes into %zu.\n", decoded_size, *size);
+	return data;
+}
+
+bool front_code_open(struct front_code *fc, const uint8_t *data, size_t size)
+{
+	if (size < HEADER_SIZE || memcmp(data, magic, sizeof(magic)) != 0) {
+		return false;
+	}
+	fc->count = get_u32(&data[sizeof(magic)]);
+	fc->num_restarts = get_u32(&data[sizeof(magic) + 4]);
+	fc->decoded_size = get_u32(&data[sizeof(magic) + 8]);
+	fc->entries_size = get_u32(&data[sizeof(magic) + 12]);
+
+	size_t restarts_size = (size_t)fc->num_restarts * sizeof(uint32_t);
+	if (fc->num_restarts != (fc->count + FRONT_CODE_RESTART_INTERVAL - 1) / FRONT_CODE_RESTART_INTERVAL
+			|| HEADER_SIZE + restarts_size + fc->entries_size != size) {
+		return false;
+	}
+	fc->restarts = data + HEADER_SIZE;
+	fc->entries = fc->restarts + restarts_size;
+	return true;
+}
+
+/*
+ * Read the entry at *pos into str, returning false if it's corrupt. Its
+ * shared prefix is copied from prev, which may be the same as str.
+ */
+static bool read_entry(
+		const struct front_code *fc,
+		size_t *pos,
+		const char *prev,
+		size_t prev_len,
+		char *str,
+		size_t max_len,
+		size_t *len)
+{
+	const uint8_t *end = fc->entries + fc->entries_size;
+	const uint8_t *p = fc->entries + *pos;
+	uint32_t shared;
+	uint32_t suffix;
+	size_t n;
+
+	if (*pos >= fc->entries_size || (n = get_varint(p, end, &shared)) == 0) {
+		return false;
+	}
+	p += n;
+	if ((n = get_varint(p, end, &suffix)) == 0) {
+		return false;
+	}
+	p += n;
+	if (shared > prev_len || suffix > (size_t)(end - p) || shared + suffix > max_len) {
+		return false;
+	}
+	if (prev != str) {
+		memcpy(str, prev, shared);
+	}
+	memcpy(&str[shared], p, suffix);
+	*len = shared + suffix;
+	*pos = (p + suffix) - fc->entries;
+	return true;
+}
+
+char *front_code_decode(const struct front_code *fc)
+{
+	char *buf = xmalloc(fc->decoded_size + 1);
+	size_t written = 0;
+	size_t pos = 0;
+	const char *prev = buf;
+	size_t prev_len = 0;
+	for (size_t i = 0; i < fc->count; i++) {
+		/*
+		 * Each string is decoded straight after the previous one, so
+		 * its shared prefix just needs copying forward.
+		 */
+		char *str = &buf[written];
+		size_t len;
+		if (i % FRONT_CODE_RESTART_INTERVAL == 0) {
+			prev_len = 0;
+		}
+		if (written >= fc->decoded_size
+				|| !read_entry(fc, &pos, prev, prev_len, str, fc->decoded_size - written - 1, &len)) {
+			log_error("Front coded data is corrupt.\n");
+			free(buf);
+			return NULL;
+		}
+		str[len] = '\n';
+		written += len + 1;
+		prev = str;
+		prev_len = len;
+	}
+	if (written != fc->decoded_size || pos != fc->entries_size) {
+		log_error("Front coded data is corrupt.\n");
+		free(buf);
+		return NULL;
+	}
+	buf[written] = '\0';
+	return buf;
+}
+
+bool front_code_find_prefix(const struct front_code *fc, const char *prefix, char *match)
+{
+	size_t prefix_len = strlen(prefix);
+	const uint8_t *end = fc->entries + fc->entries_size;
+
+	/*
+	 * Find the last restart point whose string sorts before prefix. The
+	 * string at a restart point is stored whole, so can be compared
+	 * without decoding anything else.
+	 */
+	size_t lo = 0;
+	size_t hi = fc->num_restarts;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		size_t pos = get_u32(&fc->restarts[4 * mid]);
+		if (pos >= fc->entries_size) {
+			return false;
+		}
+		const uint8_t *p = fc->entries + pos;
+		uint32_t shared;
+		uint32_t suffix;
+		size_t n = get_varint(p, end, &shared);
+		if (n == 0) {
+			return false;
+		}
+		p += n;
+		if ((n = get_varint(p, end, &suffix)) == 0 || suffix > (size_t)(end - p - n)) {
+			return false;
+		}
+		p += n;
+		size_t cmp_len = suffix < prefix_len ? suffix : prefix_len;
+		int cmp = memcmp(p, prefix, cmp_len);
+		if (cmp < 0 || (cmp == 0 && suffix < prefix_len)) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	/*
+	 * The first match, if any, is in this block or at the start of the
+	 * next one, as strings in a block are only ever greater than the
+	 * restart point's.
+	 */
+	size_t pos = fc->num_restarts > 0 ? get_u32(&fc->restarts[4 * lo]) : 0;
+	size_t len = 0;
+	for (size_t i = lo * FRONT_CODE_RESTART_INTERVAL;
+			i < fc->count && i <= (lo + 1) * FRONT_CODE_RESTART_INTERVAL;
+			i++) {
+		size_t prev_len = i % FRONT_CODE_RESTART_INTERVAL == 0 ? 0 : len;
+		if (!read_entry(fc, &pos, match, prev_len, match, FRONT_CODE_MAX_LENGTH - 1, &len)) {
+			return false;
+		}
+		match[len] = '\0';
+		int cmp = strncmp(match, prefix, prefix_len);
+		if (cmp == 0) {
+			return true;
+		} else if (cmp > 0) {
+			return false;
+		}
+	}
+	return false;
+}
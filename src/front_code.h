@@ -0,0 +1,67 @@
+#ifndef FRONT_CODE_H
+#define FRONT_CODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Front coding for sorted lists of strings, as used for the compgen cache.
+ *
+ * Sorted command names tend to share long prefixes with their neighbours
+ * (think x86_64-linux-gnu-*, python3.*, git-*), so each string is stored as
+ * the length of the prefix it shares with the previous one, followed by the
+ * rest of it. Every FRONT_CODE_RESTART_INTERVAL strings, a string is stored
+ * whole, and its offset recorded in a table of restart points. Those can be
+ * binary searched, so a lookup only has to decode one block of strings.
+ *
+ * The encoded layout is:
+ *
+ *   "tofi-fc1"
+ *   u32 count
+ *   u32 number of restart points
+ *   u32 decoded size, in bytes
+ *   u32 entries size, in bytes
+ *   u32 restart point offsets[]
+ *   entries[]
+ *
+ * with integers stored little-endian, and each entry as a varint shared
+ * prefix length, a varint suffix length and then the suffix.
+ */
+#define FRONT_CODE_RESTART_INTERVAL 16
+
+struct front_code {
+	uint32_t count;
+	uint32_t num_restarts;
+	uint32_t decoded_size;
+	const uint8_t *restarts;
+	const uint8_t *entries;
+	size_t entries_size;
+};
+
+/*
+ * Encode a newline-separated buffer, which should be sorted for lookups to
+ * work. The size of the result is returned in size.
+ */
+[[nodiscard("memory leaked")]]
+uint8_t *front_code_encode(const char *buffer, size_t *size);
+
+/* Check the header of encoded data, returning false if it's not valid. */
+bool front_code_open(struct front_code *fc, const uint8_t *data, size_t size);
+
+/*
+ * Decode everything back to a newline-separated buffer, or return NULL if
+ * the data is corrupt.
+ */
+[[nodiscard("memory leaked")]]
+char *front_code_decode(const struct front_code *fc);
+
+/*
+ * Find the first string starting with prefix, copying it into match (which
+ * should be at least FRONT_CODE_MAX_LENGTH long). Returns false if there
+ * isn't one.
+ */
+#define FRONT_CODE_MAX_LENGTH 4096
+bool front_code_find_prefix(const struct front_code *fc, const char *prefix, char *match);
+
+#endif /* FRONT_CODE_H */
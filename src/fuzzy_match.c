@@ -14,14 +14,46 @@
 static int32_t compute_score(
 		int32_t jump,
 		bool first_char,
-		const char *restrict match);
+		const char *restrict match,
+		uint32_t index,
+		const struct match_info *restrict info);
 
 static int32_t fuzzy_match_recurse(
 		const char *restrict pattern,
 		const char *restrict str,
+		uint32_t index,
 		int32_t score,
 		bool first_match_only,
-		bool first_char);
+		bool first_char,
+		const struct match_info *restrict info);
+
+/*
+ * Fill in info for str. This is done once when candidates are read in, so
+ * the work isn't repeated for every keystroke.
+ */
+void match_info_init(struct match_info *restrict info, const char *restrict str)
+{
+	info->separators = 0;
+	info->camels = 0;
+
+	uint32_t length = 0;
+	uint32_t prev = 0;
+	for (const char *c = str; *c != '\0'; c = utf8_next_char(c)) {
+		uint32_t cur = utf8_to_utf32(c);
+		if (length > 0 && length < MATCH_INFO_BITS) {
+			uint64_t bit = (uint64_t)1 << length;
+			if (utf32_isupper(cur) && utf32_islower(prev)) {
+				info->camels |= bit;
+			}
+			if (utf32_isalnum(cur) && !utf32_isalnum(prev)) {
+				info->separators |= bit;
+			}
+		}
+		prev = cur;
+		length++;
+	}
+	info->length = length;
+}
 
 /*
  * Split patterns into words, and perform simple matching against str for each.
@@ -53,14 +85,17 @@ int32_t fuzzy_match_simple_words(const char *restrict patterns, const char *rest
  * Split patterns into words, and return the sum of fuzzy_match(word, str).
  * If a word is not found, returns INT32_MIN.
  */
-int32_t fuzzy_match_words(const char *restrict patterns, const char *restrict str)
+int32_t fuzzy_match_words(
+		const char *restrict patterns,
+		const char *restrict str,
+		const struct match_info *restrict info)
 {
 	int32_t score = 0;
 	char *saveptr = NULL;
 	char *tmp = utf8_normalize(patterns);
 	char *pattern = strtok_r(tmp, " ", &saveptr);
 	while (pattern != NULL) {
-		int32_t word_score = fuzzy_match(pattern, str);
+		int32_t word_score = fuzzy_match(pattern, str, info);
 		if (word_score == INT32_MIN) {
 			score = INT32_MIN;
 			break;
@@ -73,14 +108,40 @@ int32_t fuzzy_match_words(const char *restrict patterns, const char *restrict st
 	return score;
 }
 
+/*
+ * Find the byte offset of the final component of a path, ignoring any
+ * trailing slash, so that "/usr/share/" gives the offset of "share/". Strings
+ * without a slash just give 0.
+ */
+size_t path_basename_offset(const char *str)
+{
+	size_t len = strlen(str);
+	if (len > 0 && str[len - 1] == '/') {
+		len--;
+	}
+	while (len > 0 && str[len - 1] != '/') {
+		len--;
+	}
+	return len;
+}
+
 /*
  * Returns score if each character in pattern is found sequentially within str.
  * Returns INT32_MIN otherwise.
+ *
+ * info may be NULL, in which case everything is worked out from str.
  */
-int32_t fuzzy_match(const char *restrict pattern, const char *restrict str)
+int32_t fuzzy_match(
+		const char *restrict pattern,
+		const char *restrict str,
+		const struct match_info *restrict info)
 {
+	if (info != NULL && info->length == 0) {
+		info = NULL;
+	}
+
 	const int unmatched_letter_penalty = -1;
-	const size_t slen = utf8_strlen(str);
+	const size_t slen = info ? info->length : utf8_strlen(str);
 	const size_t plen = utf8_strlen(pattern);
 	int32_t score = 0;
 
@@ -119,14 +180,15 @@ int32_t fuzzy_match(const char *restrict pattern, const char *restrict str)
         bool first_match_only = slen > 100;
 
 	/* Perform the match. */
-	score = fuzzy_match_recurse(pattern, str, score, first_match_only, true);
+	score = fuzzy_match_recurse(pattern, str, 0, score, first_match_only, true, info);
 
 	return score;
 }
 
 /*
  * Recursively match the whole of pattern against str.
- * The score parameter is the score of the previously matched character.
+ * The score parameter is the score of the previously matched character, and
+ * index is the position of str in the original string, in codepoints.
  *
  * This reaches a maximum recursion depth of strlen(pattern) + 1. However, the
  * stack usage is small (the maximum I've seen on x86_64 is 144 bytes with
@@ -136,37 +198,40 @@ int32_t fuzzy_match(const char *restrict pattern, const char *restrict str)
 int32_t fuzzy_match_recurse(
 		const char *restrict pattern,
 		const char *restrict str,
+		uint32_t index,
 		int32_t score,
 		bool first_match_only,
-		bool first_char)
+		bool first_char,
+		const struct match_info *restrict info)
 {
 	if (*pattern == '\0') {
 		/* We've matched the full pattern. */
 		return score;
 	}
 
-	const char *match = str;
-	uint32_t search = utf8_to_utf32(pattern);
+	uint32_t search = utf32_tolower(utf8_to_utf32(pattern));
 
 	int32_t best_score = INT32_MIN;
 
 	/*
 	 * Find all occurrences of the next pattern character in str, and
-	 * recurse on them.
+	 * recurse on them. We count characters as we go, so that the jump
+	 * to each match doesn't have to be counted again afterwards.
 	 */
-	while ((match = utf8_strcasechr(match, search)) != NULL) {
-		int32_t jump = 0;
-		for (const char *tmp = str; tmp != match; tmp = utf8_next_char(tmp)) {
-			jump++;
+	uint32_t match_index = index;
+	for (const char *match = str; *match != '\0'; match = utf8_next_char(match), match_index++) {
+		if (utf32_tolower(utf8_to_utf32(match)) != search) {
+			continue;
 		}
 		int32_t subscore = fuzzy_match_recurse(
 				utf8_next_char(pattern),
 				utf8_next_char(match),
-				compute_score(jump, first_char, match),
+				match_index + 1,
+				compute_score(match_index - index, first_char, match, match_index, info),
 				first_match_only,
-				false);
+				false,
+				info);
 		best_score = MAX(best_score, subscore);
-		match = utf8_next_char(match);
 
 		if (first_match_only) {
 			break;
@@ -195,8 +260,16 @@ int32_t fuzzy_match_recurse(
  *   - Penalties:
  *     - If there are letters before the first match.
  *     - If there are superfluous characters in str (already accounted for).
+ *
+ * Where possible, the bonuses are looked up in info using index, the
+ * position of match in the original string.
  */
-int32_t compute_score(int32_t jump, bool first_char, const char *restrict match)
+int32_t compute_score(
+		int32_t jump,
+		bool first_char,
+		const char *restrict match,
+		uint32_t index,
+		const struct match_info *restrict info)
 {
 	const int adjacency_bonus = 15;
 	const int separator_bonus = 30;
@@ -208,13 +281,21 @@ int32_t compute_score(int32_t jump, bool first_char, const char *restrict match)
 
 	int32_t score = 0;
 
-	const uint32_t cur = utf8_to_utf32(match);
-
 	/* Apply bonuses. */
 	if (!first_char && jump == 0) {
 		score += adjacency_bonus;
 	}
-	if (!first_char || jump > 0) {
+	if (info != NULL && index < MATCH_INFO_BITS) {
+		/* Bit 0 is never set, as there's no previous character. */
+		const uint64_t bit = (uint64_t)1 << index;
+		if (info->camels & bit) {
+			score += camel_bonus;
+		}
+		if (info->separators & bit) {
+			score += separator_bonus;
+		}
+	} else if (!first_char || jump > 0) {
+		const uint32_t cur = utf8_to_utf32(match);
 		const uint32_t prev = utf8_to_utf32(utf8_prev_char(match));
 		if (utf32_isupper(cur) && utf32_islower(prev)) {
 			score += camel_bonus;
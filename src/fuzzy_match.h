@@ -1,10 +1,38 @@
 #ifndef FUZZY_MATCH_H
 #define FUZZY_MATCH_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/*
+ * Details of a candidate string that fuzzy matching would otherwise have to
+ * work out again for every keystroke: its length in codepoints, and bitmaps of
+ * which characters come after a separator or start a camelCase word. The
+ * bitmaps only cover the first MATCH_INFO_BITS characters, beyond which
+ * characters are classified on the fly.
+ *
+ * A length of 0 means the info hasn't been filled in, and is ignored.
+ */
+#define MATCH_INFO_BITS 64
+
+struct match_info {
+	uint64_t separators;
+	uint64_t camels;
+	uint32_t length;
+};
+
+void match_info_init(struct match_info *restrict info, const char *restrict str);
+
 int32_t fuzzy_match_simple_words(const char *restrict patterns, const char *restrict str);
-int32_t fuzzy_match_words(const char *restrict patterns, const char *restrict str);
-int32_t fuzzy_match(const char *restrict pattern, const char *restrict str);
+int32_t fuzzy_match_words(
+		const char *restrict patterns,
+		const char *restrict str,
+		const struct match_info *restrict info);
+int32_t fuzzy_match(
+		const char *restrict pattern,
+		const char *restrict str,
+		const struct match_info *restrict info);
+size_t path_basename_offset(const char *str);
 
 #endif /* FUZZY_MATCH_H */
@@ -0,0 +1,184 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "group_cache.h"
+#include "log.h"
+#include "xmalloc.h"
+
+/*
+ * Marks a score that hasn't been worked out yet. No group can really score
+ * this, as the worst possible fuzzy match is nowhere near it.
+ */
+#define SCORE_UNKNOWN (INT32_MIN + 1)
+
+/*
+ * Describe a group as a string, so we can tell whether we've seen it before.
+ * Patterns never contain spaces, as that's what the input is split on.
+ */
+static char *group_key(const struct query *query, const struct query_group *group)
+{
+	size_t size = 2;
+	for (size_t i = 0; i < group->count; i++) {
+		size += group->terms[i].length + 3;
+	}
+	char *key = xmalloc(size);
+	char *c = key;
+	*c++ = query->path ? 'p' : '-';
+	for (size_t i = 0; i < group->count; i++) {
+		const struct query_term *term = &group->terms[i];
+		*c++ = '0' + term->type;
+		*c++ = term->negate ? '!' : '=';
+		memcpy(c, term->pattern, term->length);
+		c += term->length;
+		*c++ = ' ';
+	}
+	*c = '\0';
+	return key;
+}
+
+static void entry_clear(struct group_cache_entry *entry)
+{
+	free(entry->key);
+	free(entry->scores);
+	entry->key = NULL;
+	entry->scores = NULL;
+	entry->scores_size = 0;
+	entry->last_used = 0;
+}
+
+/*
+ * Find the entry for a group, or make one, replacing the least recently used
+ * entry that isn't in use by the current query. Returns NULL if they all
+ * are, in which case the group just doesn't get cached.
+ */
+static struct group_cache_entry *find_entry(
+		struct group_cache *cache,
+		const struct query *query,
+		const struct query_group *group)
+{
+	char *key = group_key(query, group);
+	struct group_cache_entry *victim = NULL;
+	for (size_t i = 0; i < GROUP_CACHE_SIZE; i++) {
+		struct group_cache_entry *entry = &cache->entries[i];
+		if (entry->key != NULL && !strcmp(entry->key, key)) {
+			free(key);
+			entry->last_used = cache->clock;
+			return entry;
+		}
+		if (entry->last_used == cache->clock && entry->key != NULL) {
+			continue;
+		}
+		if (victim == NULL || entry->last_used < victim->last_used) {
+			victim = entry;
+		}
+	}
+	if (victim == NULL) {
+		free(key);
+		return NULL;
+	}
+
+	free(victim->key);
+	victim->key = key;
+	if (victim->scores_size < cache->count) {
+		free(victim->scores);
+		victim->scores = xmalloc(cache->count * sizeof(*victim->scores));
+		victim->scores_size = cache->count;
+	}
+	for (size_t i = 0; i < cache->count; i++) {
+		victim->scores[i] = SCORE_UNKNOWN;
+	}
+	victim->last_used = cache->clock;
+	return victim;
+}
+
+struct string_ref_vec group_cache_filter(
+		struct group_cache *cache,
+		const struct string_ref_vec *source,
+		const struct query *query)
+{
+	if (query->num_groups == 0) {
+		return string_ref_vec_copy(source);
+	}
+	if (source != cache->source || source->buf != cache->buf || source->count != cache->count) {
+		group_cache_reset(cache);
+		cache->source = source;
+		cache->buf = source->buf;
+		cache->count = source->count;
+	}
+
+	/*
+	 * The clock is bumped for each query, so that entries used by this
+	 * one can be told apart from older ones.
+	 */
+	cache->clock++;
+	struct group_cache_entry **entries = xcalloc(query->num_groups, sizeof(*entries));
+	size_t num_cached = 0;
+	for (size_t i = 0; i < query->num_groups; i++) {
+		entries[i] = find_entry(cache, query, &query->groups[i]);
+		if (entries[i] != NULL) {
+			num_cached++;
+		}
+	}
+	log_debug("Filtering with %zu of %zu query groups cached.\n", num_cached, query->num_groups);
+
+	struct string_ref_vec filt = string_ref_vec_create();
+	for (size_t i = 0; i < source->count; i++) {
+		const struct scored_string_ref *str = &source->buf[i];
+
+		/* First rule out anything we already know doesn't match. */
+		bool match = true;
+		for (size_t j = 0; j < query->num_groups; j++) {
+			if (entries[j] != NULL && entries[j]->scores[i] == INT32_MIN) {
+				match = false;
+				break;
+			}
+		}
+		if (!match) {
+			continue;
+		}
+
+		int32_t search_score = 0;
+		for (size_t j = 0; j < query->num_groups; j++) {
+			int32_t score = entries[j] != NULL ? entries[j]->scores[i] : SCORE_UNKNOWN;
+			if (score == SCORE_UNKNOWN) {
+				score = query_match_group(
+						query,
+						&query->groups[j],
+						str->string,
+						str->basename,
+						&str->info);
+				if (entries[j] != NULL) {
+					entries[j]->scores[i] = score;
+				}
+			}
+			if (score == INT32_MIN) {
+				match = false;
+				break;
+			}
+			search_score += score;
+		}
+		if (!match) {
+			continue;
+		}
+
+		string_ref_vec_add(&filt, str->string);
+		filt.buf[filt.count - 1].search_score = search_score;
+		filt.buf[filt.count - 1].history_score = str->history_score;
+		filt.buf[filt.count - 1].basename = str->basename;
+		filt.buf[filt.count - 1].info = str->info;
+	}
+	free(entries);
+
+	string_ref_vec_sort_by_score(&filt);
+	return filt;
+}
+
+void group_cache_reset(struct group_cache *cache)
+{
+	for (size_t i = 0; i < GROUP_CACHE_SIZE; i++) {
+		entry_clear(&cache->entries[i]);
+	}
+	cache->source = NULL;
+	cache->buf = NULL;
+	cache->count = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef GROUP_CACHE_H
+#define GROUP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "query.h"
+#include "string_vec.h"
+
+#define GROUP_CACHE_SIZE 8
+
+/*
+ * Remembers the score of each candidate against each of the last few query
+ * groups (i.e. words) we've seen. The total score of a query is just the sum
+ * of its groups' scores, so when a word in the middle of the input is
+ * edited, only that word needs matching against the candidates again, and
+ * candidates already ruled out by the other words can be skipped straight
+ * away.
+ *
+ * Scores are only worked out as they're needed, as matching stops at the
+ * first group that fails, so any that haven't been yet are marked unknown.
+ */
+struct group_cache_entry {
+	char *key;
+	/* Kept when the entry's replaced, and only grown, to save allocating. */
+	int32_t *scores;
+	size_t scores_size;
+	uint64_t last_used;
+};
+
+struct group_cache {
+	/* The candidates the scores are for. */
+	const struct string_ref_vec *source;
+	const struct scored_string_ref *buf;
+	size_t count;
+
+	struct group_cache_entry entries[GROUP_CACHE_SIZE];
+	uint64_t clock;
+};
+
+/*
+ * Like string_ref_vec_filter(), but reusing any scores for the query's groups
+ * that are already known. If source isn't what the cache was last used with,
+ * it's reset first.
+ */
+[[nodiscard("memory leaked")]]
+struct string_ref_vec group_cache_filter(
+		struct group_cache *cache,
+		const struct string_ref_vec *source,
+		const struct query *query);
+
+void group_cache_reset(struct group_cache *cache);
+
+#endif /* GROUP_CACHE_H */
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include "history.h"
+#include "intern.h"
 #include "log.h"
 #include "mkdirp.h"
 #include "xmalloc.h"
@@ -127,7 +128,7 @@ void history_save(const struct history *history, const char *path)
 	}
 
 	/* Use open rather than fopen to ensure the proper permissions. */
-	int histfd = open(path, O_WRONLY | O_CREAT, 0600);
+	int histfd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
 	FILE *histfile = fdopen(histfd, "wb");
 	if (histfile == NULL) {
 		return;
@@ -175,20 +176,19 @@ struct history history_create(void)
 
 void history_destroy(struct history *restrict vec)
 {
-	for (size_t i = 0; i < vec->count; i++) {
-		free(vec->buf[i].name);
-	}
 	free(vec->buf);
 }
 
 void history_add(struct history *restrict vec, const char *restrict str)
 {
+	const char *name = intern(str);
+
 	/*
 	 * If the program's already in our vector, just increment the count and
 	 * move the program up if needed.
 	 */
 	for (size_t i = 0; i < vec->count; i++) {
-		if (!strcmp(vec->buf[i].name, str)) {
+		if (vec->buf[i].name == name) {
 			vec->buf[i].run_count++;
 			size_t count = vec->buf[i].run_count;
 			if (i > 0 && count <= vec->buf[i-1].run_count) {
@@ -211,21 +211,52 @@ void history_add(struct history *restrict vec, const char *restrict str)
 		vec->size *= 2;
 		vec->buf = xrealloc(vec->buf, vec->size * sizeof(vec->buf[0]));
 	}
-	vec->buf[vec->count].name = xstrdup(str);
+	vec->buf[vec->count].name = name;
 	vec->buf[vec->count].run_count = 1;
 	vec->count++;
 }
 
 void history_remove(struct history *restrict vec, const char *restrict str)
 {
+	const char *name = intern(str);
 	for (size_t i = 0; i < vec->count; i++) {
-		if (!strcmp(vec->buf[i].name, str)) {
-			free(vec->buf[i].name);
+		if (vec->buf[i].name == name) {
 			if (i < vec->count - 1) {
-				memmove(&vec->buf[i], &vec->buf[i+1], (vec->count - i) * sizeof(struct program));
+				memmove(&vec->buf[i], &vec->buf[i+1], (vec->count - i - 1) * sizeof(struct program));
 			}
 			vec->count--;
 			return;
 		}
 	}
 }
+
+void history_merge_duplicates(struct history *restrict vec)
+{
+	/* Histories are short, so the quadratic approach is fine. */
+	for (size_t i = 0; i < vec->count; i++) {
+		size_t j = i + 1;
+		while (j < vec->count) {
+			if (vec->buf[i].name != vec->buf[j].name) {
+				j++;
+				continue;
+			}
+			vec->buf[i].run_count += vec->buf[j].run_count;
+			memmove(&vec->buf[j], &vec->buf[j+1], (vec->count - j - 1) * sizeof(struct program));
+			vec->count--;
+		}
+	}
+
+	/*
+	 * Restore the ordering by run count. This is an insertion sort, so
+	 * ties keep their current order, just as in history_add().
+	 */
+	for (size_t i = 1; i < vec->count; i++) {
+		struct program tmp = vec->buf[i];
+		size_t j = i;
+		while (j > 0 && tmp.run_count > vec->buf[j-1].run_count) {
+			j--;
+		}
+		memmove(&vec->buf[j+1], &vec->buf[j], (i - j) * sizeof(struct program));
+		vec->buf[j] = tmp;
+	}
+}
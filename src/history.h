@@ -5,7 +5,8 @@
 #include <stddef.h>
 
 struct program {
-	char *restrict name;
+	/* Interned, see intern.h. */
+	const char *name;
 	size_t run_count;
 };
 
@@ -24,6 +25,9 @@ void history_add(struct history *restrict vec, const char *restrict str);
 //[[gnu::nonnull]]
 //void history_remove(struct history *restrict vec, const char *restrict str);
 
+[[gnu::nonnull]]
+void history_merge_duplicates(struct history *restrict vec);
+
 [[nodiscard("memory leaked")]]
 struct history history_load(const char *path);
 
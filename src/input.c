@@ -1,22 +1,54 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/input-event-codes.h>
+#include <string.h>
 #include <unistd.h>
+#include "filter_thread.h"
+#include "group_cache.h"
 #include "input.h"
 #include "log.h"
 #include "nelem.h"
+#include "recorder.h"
+#include "speculate.h"
 #include "tofi.h"
 #include "unicode.h"
 
-
-static void add_character(struct tofi *tofi, xkb_keycode_t keycode);
-static void delete_character(struct tofi *tofi);
-static void delete_word(struct tofi *tofi);
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+ * With sort=false, results are only filtered as far as is needed to draw the
+ * current page. If num-results isn't set, we don't know how many results will
+ * fit until they've been drawn, so assume it's no more than this.
+ */
+#define MAX_AUTO_RESULTS 256
+
+static struct input_event translate_keypress(struct tofi *tofi, xkb_keycode_t keycode);
+static void apply_repeated(struct tofi *tofi, struct input_event event, uint32_t count);
+static void add_character(struct tofi *tofi, uint32_t ch, uint32_t count);
+static bool append_character(struct entry *entry, uint32_t ch);
+static void delete_character(struct tofi *tofi, uint32_t count);
+static void delete_next_character(struct tofi *tofi, uint32_t count);
+static void delete_word(struct tofi *tofi, uint32_t count);
+static void remove_characters(struct entry *entry, uint32_t start, uint32_t count);
+static void cursor_left(struct tofi *tofi, uint32_t count);
+static void cursor_right(struct tofi *tofi, uint32_t count);
+static void cursor_start(struct tofi *tofi);
+static void cursor_end(struct tofi *tofi);
 static void clear_input(struct tofi *tofi);
 static void paste(struct tofi *tofi);
 static void select_previous_result(struct tofi *tofi);
 static void select_next_result(struct tofi *tofi);
+static void scroll_up(struct tofi *tofi);
+static void scroll_down(struct tofi *tofi);
 static void reset_selection(struct tofi *tofi);
+static void compile_query(struct tofi *tofi);
+static struct string_ref_vec filter_apps(struct tofi *tofi);
+static bool lazy_filtering(const struct tofi *tofi);
+static bool filter_async(struct tofi *tofi);
+static void install_results(struct tofi *tofi, struct string_ref_vec results);
+static void filter_more_results(struct tofi *tofi, size_t count);
+static uint32_t page_size(const struct entry *entry);
 
 void input_handle_keypress(struct tofi *tofi, xkb_keycode_t keycode)
 {
@@ -24,6 +56,63 @@ void input_handle_keypress(struct tofi *tofi, xkb_keycode_t keycode)
 		return;
 	}
 
+	struct input_event event = translate_keypress(tofi, keycode);
+	if (event.action == INPUT_ACTION_NONE) {
+		return;
+	}
+	recorder_event(&tofi->recorder, &event);
+	input_apply(tofi, event);
+}
+
+/*
+ * Handle count repeats of a held key in one go. If filtering or drawing
+ * takes longer than the repeat interval, repeats due since the last one are
+ * batched up here, so that there's only one filter and one redraw for them
+ * all rather than one each, and we never fall further and further behind.
+ */
+void input_handle_repeat(struct tofi *tofi, xkb_keycode_t keycode, uint32_t count)
+{
+	if (tofi->xkb_state == NULL || count == 0) {
+		return;
+	}
+
+	struct input_event event = translate_keypress(tofi, keycode);
+	if (event.action == INPUT_ACTION_NONE) {
+		return;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		recorder_event(&tofi->recorder, &event);
+	}
+	apply_repeated(tofi, event, count);
+}
+
+/*
+ * Handle the mouse wheel, which moves the selection like the arrow keys, but
+ * scrolls the results by a row at a time rather than a page. Negative steps
+ * are up.
+ */
+void input_handle_scroll(struct tofi *tofi, int32_t steps)
+{
+	if (steps == 0) {
+		return;
+	}
+	struct input_event event = {
+		.action = steps < 0 ? INPUT_ACTION_SCROLL_UP : INPUT_ACTION_SCROLL_DOWN
+	};
+	uint32_t count = steps < 0 ? -(int64_t)steps : steps;
+	for (uint32_t i = 0; i < count; i++) {
+		recorder_event(&tofi->recorder, &event);
+	}
+	apply_repeated(tofi, event, count);
+}
+
+/*
+ * Work out what a keypress should do.
+ */
+struct input_event translate_keypress(struct tofi *tofi, xkb_keycode_t keycode)
+{
+	struct input_event event = { .action = INPUT_ACTION_NONE };
+
 	/*
 	 * Use physical key code for shortcuts, ignoring layout changes.
 	 * Linux keycodes are 8 less than XKB keycodes.
@@ -36,16 +125,19 @@ void input_handle_keypress(struct tofi *tofi, xkb_keycode_t keycode)
 			tofi->xkb_state,
 			keycode);
 	if (utf32_isprint(ch)) {
-		add_character(tofi, keycode);
+		event.action = INPUT_ACTION_ADD_CHARACTER;
+		event.character = ch;
 	} else if ((sym == XKB_KEY_BackSpace || key == KEY_W)
 			&& xkb_state_mod_name_is_active(
 				tofi->xkb_state,
 				XKB_MOD_NAME_CTRL,
 				XKB_STATE_MODS_EFFECTIVE))
 	{
-		delete_word(tofi);
+		event.action = INPUT_ACTION_DELETE_WORD;
 	} else if (sym == XKB_KEY_BackSpace) {
-		delete_character(tofi);
+		event.action = INPUT_ACTION_DELETE_CHARACTER;
+	} else if (sym == XKB_KEY_Delete) {
+		event.action = INPUT_ACTION_DELETE_NEXT_CHARACTER;
 	} else if (key == KEY_U
 			&& xkb_state_mod_name_is_active(
 				tofi->xkb_state,
@@ -53,7 +145,7 @@ void input_handle_keypress(struct tofi *tofi, xkb_keycode_t keycode)
 				XKB_STATE_MODS_EFFECTIVE)
 		   )
 	{
-		clear_input(tofi);
+		event.action = INPUT_ACTION_CLEAR;
 	} else if ((key == KEY_V || key == KEY_Y)
 			&& xkb_state_mod_name_is_active(
 				tofi->xkb_state,
@@ -61,7 +153,43 @@ void input_handle_keypress(struct tofi *tofi, xkb_keycode_t keycode)
 				XKB_STATE_MODS_EFFECTIVE)
 		   )
 	{
-		paste(tofi);
+		event.action = INPUT_ACTION_PASTE;
+	} else if (key == KEY_B
+			&& xkb_state_mod_name_is_active(
+				tofi->xkb_state,
+				XKB_MOD_NAME_CTRL,
+				XKB_STATE_MODS_EFFECTIVE)
+		   )
+	{
+		/*
+		 * Left and Right already move through the results, so the
+		 * cursor gets the Emacs-style bindings instead.
+		 */
+		event.action = INPUT_ACTION_CURSOR_LEFT;
+	} else if (key == KEY_F
+			&& xkb_state_mod_name_is_active(
+				tofi->xkb_state,
+				XKB_MOD_NAME_CTRL,
+				XKB_STATE_MODS_EFFECTIVE)
+		   )
+	{
+		event.action = INPUT_ACTION_CURSOR_RIGHT;
+	} else if (key == KEY_A
+			&& xkb_state_mod_name_is_active(
+				tofi->xkb_state,
+				XKB_MOD_NAME_CTRL,
+				XKB_STATE_MODS_EFFECTIVE)
+		   )
+	{
+		event.action = INPUT_ACTION_CURSOR_START;
+	} else if (key == KEY_E
+			&& xkb_state_mod_name_is_active(
+				tofi->xkb_state,
+				XKB_MOD_NAME_CTRL,
+				XKB_STATE_MODS_EFFECTIVE)
+		   )
+	{
+		event.action = INPUT_ACTION_CURSOR_END;
 	} else if (sym == XKB_KEY_Up || sym == XKB_KEY_Left || sym == XKB_KEY_ISO_Left_Tab
 			|| ((key == KEY_K || key == KEY_P)
 				&& xkb_state_mod_name_is_active(
@@ -70,7 +198,7 @@ void input_handle_keypress(struct tofi *tofi, xkb_keycode_t keycode)
 					XKB_STATE_MODS_EFFECTIVE)
 			   )
 	   ) {
-		select_previous_result(tofi);
+		event.action = INPUT_ACTION_SELECT_PREVIOUS;
 	} else if (sym == XKB_KEY_Down || sym == XKB_KEY_Right || sym == XKB_KEY_Tab
 			|| ((key == KEY_J || key == KEY_N)
 				&& xkb_state_mod_name_is_active(
@@ -79,9 +207,9 @@ void input_handle_keypress(struct tofi *tofi, xkb_keycode_t keycode)
 					XKB_STATE_MODS_EFFECTIVE)
 			   )
 		  ) {
-		select_next_result(tofi);
+		event.action = INPUT_ACTION_SELECT_NEXT;
 	} else if (sym == XKB_KEY_Home) {
-		reset_selection(tofi);
+		event.action = INPUT_ACTION_RESET_SELECTION;
 	} else if (sym == XKB_KEY_Escape
 			|| (key == KEY_C
 				&& xkb_state_mod_name_is_active(
@@ -91,11 +219,88 @@ void input_handle_keypress(struct tofi *tofi, xkb_keycode_t keycode)
 			   )
 		  )
 	{
-		tofi->closed = true;
-		return;
+		event.action = INPUT_ACTION_CLOSE;
 	} else if (sym == XKB_KEY_Return || sym == XKB_KEY_KP_Enter) {
-		tofi->submit = true;
-		return;
+		event.action = INPUT_ACTION_SUBMIT;
+	}
+
+	return event;
+}
+
+void input_apply(struct tofi *tofi, struct input_event event)
+{
+	apply_repeated(tofi, event, 1);
+}
+
+/*
+ * Apply an event count times. Edits are made all at once, and the results
+ * only updated at the end. Actions that don't make sense to repeat are only
+ * applied once.
+ */
+void apply_repeated(struct tofi *tofi, struct input_event event, uint32_t count)
+{
+	switch (event.action) {
+		case INPUT_ACTION_NONE:
+			return;
+		case INPUT_ACTION_ADD_CHARACTER:
+			add_character(tofi, event.character, count);
+			break;
+		case INPUT_ACTION_DELETE_CHARACTER:
+			delete_character(tofi, count);
+			break;
+		case INPUT_ACTION_DELETE_NEXT_CHARACTER:
+			delete_next_character(tofi, count);
+			break;
+		case INPUT_ACTION_DELETE_WORD:
+			delete_word(tofi, count);
+			break;
+		case INPUT_ACTION_CURSOR_LEFT:
+			cursor_left(tofi, count);
+			break;
+		case INPUT_ACTION_CURSOR_RIGHT:
+			cursor_right(tofi, count);
+			break;
+		case INPUT_ACTION_CURSOR_START:
+			cursor_start(tofi);
+			break;
+		case INPUT_ACTION_CURSOR_END:
+			cursor_end(tofi);
+			break;
+		case INPUT_ACTION_CLEAR:
+			clear_input(tofi);
+			break;
+		case INPUT_ACTION_PASTE:
+			paste(tofi);
+			break;
+		case INPUT_ACTION_SELECT_PREVIOUS:
+			for (uint32_t i = 0; i < count; i++) {
+				select_previous_result(tofi);
+			}
+			break;
+		case INPUT_ACTION_SELECT_NEXT:
+			for (uint32_t i = 0; i < count; i++) {
+				select_next_result(tofi);
+			}
+			break;
+		case INPUT_ACTION_SCROLL_UP:
+			for (uint32_t i = 0; i < count; i++) {
+				scroll_up(tofi);
+			}
+			break;
+		case INPUT_ACTION_SCROLL_DOWN:
+			for (uint32_t i = 0; i < count; i++) {
+				scroll_down(tofi);
+			}
+			break;
+		case INPUT_ACTION_RESET_SELECTION:
+			reset_selection(tofi);
+			break;
+		case INPUT_ACTION_CLOSE:
+			tofi->closed = true;
+			return;
+		case INPUT_ACTION_SUBMIT:
+			tofi->submit = true;
+			return;
 	}
 
 	tofi->window.surface.redraw = true;
@@ -107,41 +312,143 @@ void reset_selection(struct tofi *tofi) {
 	entry->first_result = 0;
 }
 
-void add_character(struct tofi *tofi, xkb_keycode_t keycode)
+/*
+ * Add count copies of ch to the input at the cursor, and update the results.
+ */
+void add_character(struct tofi *tofi, uint32_t ch, uint32_t count)
 {
 	struct entry *entry = &tofi->window.entry;
 
-	if (entry->input_utf32_length >= N_ELEM(entry->input_utf32) - 1) {
+	if (entry->cursor_position < entry->input_utf32_length) {
+		/*
+		 * An edit in the middle of the input can add results as well
+		 * as remove them, e.g. by splitting a word in two, so none of
+		 * the tricks below for typing at the end apply. Any words
+		 * that haven't changed will still have their scores cached.
+		 */
+		uint32_t text[MAX_INPUT_LENGTH];
+		size_t length = MIN(count, N_ELEM(text));
+		for (size_t i = 0; i < length; i++) {
+			text[i] = ch;
+		}
+		input_insert_text(tofi, text, length);
+		return;
+	}
+
+	uint32_t added = 0;
+	while (added < count && append_character(entry, ch)) {
+		added++;
+	}
+	if (added == 0) {
 		/* No more room for input */
 		return;
 	}
 
-	char buf[5]; /* 4 UTF-8 bytes plus null terminator. */
-	int len = xkb_state_key_get_utf8(
-			tofi->xkb_state,
-			keycode,
-			buf,
-			sizeof(buf));
-	entry->input_utf32[entry->input_utf32_length] = utf8_to_utf32(buf);
-	entry->input_utf32_length++;
-	entry->input_utf32[entry->input_utf32_length] = U'\0';
-	memcpy(&entry->input_utf8[entry->input_utf8_length],
-			buf,
-			N_ELEM(buf));
-	entry->input_utf8_length += len;
-	if (entry->drun) {
-		struct string_ref_vec results = desktop_vec_filter(&entry->apps, entry->input_utf8, tofi->fuzzy_match);
+	/*
+	 * If both the old and new input are plain words, the new results must
+	 * be a subset of the old ones, so we only need to look at those.
+	 */
+	bool was_plain = entry->query.plain;
+	compile_query(tofi);
+	bool narrow = was_plain && entry->query.plain;
+
+	/* Speculation only ever guesses a single character ahead. */
+	struct string_ref_vec results;
+	if (added == 1 && speculate_take(tofi, ch, &results)) {
+		/* We guessed this character while idle, so we're done. */
+		string_ref_vec_destroy(&entry->results);
+		entry->results = results;
+	} else if (filter_async(tofi)) {
+		/*
+		 * Keep showing the old results until the filter thread is
+		 * done with the new ones.
+		 */
+	} else if (entry->drun) {
+		results = filter_apps(tofi);
+		string_ref_vec_destroy(&entry->results);
+		entry->results = results;
+	} else if (lazy_filtering(tofi)) {
+		/*
+		 * Narrow down the results we've got so far, which cover the
+		 * commands up to entry->filter_position, then carry on from
+		 * there.
+		 */
+		results = string_ref_vec_create();
+		if (narrow) {
+			string_ref_vec_filter_range(
+					&entry->results,
+					0,
+					entry->results.count,
+					&entry->query,
+					&results);
+		} else {
+			entry->filter_position = 0;
+		}
 		string_ref_vec_destroy(&entry->results);
 		entry->results = results;
+		filter_more_results(tofi, page_size(entry));
 	} else {
 		struct string_ref_vec tmp = entry->results;
-		entry->results = string_ref_vec_filter(&entry->results, entry->input_utf8, tofi->fuzzy_match);
+		if (narrow) {
+			entry->results = string_ref_vec_filter(&entry->results, &entry->query);
+		} else {
+			entry->results = group_cache_filter(&tofi->groups, &entry->commands, &entry->query);
+		}
 		string_ref_vec_destroy(&tmp);
 	}
+	speculate_reset(tofi);
 
 	reset_selection(tofi);
 }
 
+/*
+ * Add ch to the end of the input, where the cursor is, without touching the
+ * results. Returns false if there's no more room.
+ */
+bool append_character(struct entry *entry, uint32_t ch)
+{
+	if (entry->input_utf32_length >= N_ELEM(entry->input_utf32) - 1) {
+		return false;
+	}
+
+	char buf[5] = { 0 }; /* 4 UTF-8 bytes plus null terminator. */
+	int len = utf32_to_utf8(ch, buf);
+	entry->input_utf32[entry->input_utf32_length] = ch;
+	entry->input_utf32_length++;
+	entry->input_utf32[entry->input_utf32_length] = U'\0';
+	memcpy(&entry->input_utf8[entry->input_utf8_length],
+			buf,
+			N_ELEM(buf));
+	entry->input_utf8_length += len;
+	entry->cursor_position = entry->input_utf32_length;
+	return true;
+}
+
+/*
+ * Insert text at the cursor, and update the results. Anything that doesn't
+ * fit is dropped.
+ */
+void input_insert_text(struct tofi *tofi, const uint32_t *text, size_t length)
+{
+	struct entry *entry = &tofi->window.entry;
+
+	length = MIN(length, N_ELEM(entry->input_utf32) - 1 - entry->input_utf32_length);
+	if (length == 0) {
+		return;
+	}
+
+	uint32_t *cursor = &entry->input_utf32[entry->cursor_position];
+	memmove(cursor + length,
+			cursor,
+			(entry->input_utf32_length - entry->cursor_position) * sizeof(*cursor));
+	memcpy(cursor, text, length * sizeof(*text));
+	entry->input_utf32_length += length;
+	entry->cursor_position += length;
+	entry->input_utf32[entry->input_utf32_length] = U'\0';
+
+	input_refresh_results(tofi);
+}
+
 void input_refresh_results(struct tofi *tofi)
 {
 	struct entry *entry = &tofi->window.entry;
@@ -154,61 +461,305 @@ void input_refresh_results(struct tofi *tofi)
 	}
 	entry->input_utf8[bytes_written] = '\0';
 	entry->input_utf8_length = bytes_written;
+	compile_query(tofi);
+	if (filter_async(tofi)) {
+		reset_selection(tofi);
+		return;
+	}
 	string_ref_vec_destroy(&entry->results);
 	if (entry->drun) {
-		entry->results = desktop_vec_filter(&entry->apps, entry->input_utf8, tofi->fuzzy_match);
+		entry->results = filter_apps(tofi);
+	} else if (lazy_filtering(tofi)) {
+		entry->results = string_ref_vec_create();
+		entry->filter_position = 0;
+		filter_more_results(tofi, page_size(entry));
 	} else {
-		entry->results = string_ref_vec_filter(&entry->commands, entry->input_utf8, tofi->fuzzy_match);
+		entry->results = group_cache_filter(&tofi->groups, &entry->commands, &entry->query);
 	}
+	speculate_reset(tofi);
 
 	reset_selection(tofi);
 }
 
-void delete_character(struct tofi *tofi)
+/*
+ * Show the newest results from the filter thread, if there are any. This
+ * may be for an older input than the current one if we're typing faster
+ * than the thread can keep up, but it's better than showing nothing new.
+ */
+void input_take_results(struct tofi *tofi)
+{
+	struct string_ref_vec results;
+	if (filter_thread_take(&tofi->filter, &results)) {
+		install_results(tofi, results);
+	}
+}
+
+/*
+ * Wait for the filter thread to catch up with the current input, so that
+ * the results are up to date, e.g. before submitting the selected one.
+ */
+void input_wait_results(struct tofi *tofi)
+{
+	struct string_ref_vec results;
+	if (filter_thread_wait(&tofi->filter, &results)) {
+		install_results(tofi, results);
+	}
+}
+
+/*
+ * The selection was already reset when the results were requested, so if
+ * it's moved since then, the user has picked something from the old results
+ * while waiting. Keep it selected if it's still there, on the same row if
+ * possible, or otherwise keep the selection in range.
+ */
+void install_results(struct tofi *tofi, struct string_ref_vec results)
+{
+	struct entry *entry = &tofi->window.entry;
+	size_t index = entry->first_result + entry->selection;
+	const char *selected = NULL;
+	if (index < entry->results.count) {
+		selected = entry->results.buf[index].string;
+	}
+	string_ref_vec_destroy(&entry->results);
+	entry->results = results;
+
+	if (index > 0 && results.count > 0) {
+		size_t found = MIN(index, results.count - 1);
+		for (size_t i = 0; i < results.count; i++) {
+			if (results.buf[i].string == selected) {
+				found = i;
+				break;
+			}
+		}
+		entry->selection = MIN(entry->selection, found);
+		entry->first_result = found - entry->selection;
+	} else {
+		reset_selection(tofi);
+	}
+	speculate_reset(tofi);
+	tofi->window.surface.redraw = true;
+}
+
+/*
+ * Parse the current input into entry->query, so that it only has to be done
+ * once per keystroke, rather than once per candidate.
+ */
+void compile_query(struct tofi *tofi)
+{
+	struct entry *entry = &tofi->window.entry;
+	query_destroy(&entry->query);
+	entry->query = query_compile(entry->input_utf8, tofi->fuzzy_match, tofi->path_match);
+}
+
+/*
+ * Filter the list of apps in drun mode. There aren't many apps, so this is
+ * always done in one go, even if they're not to be sorted.
+ */
+struct string_ref_vec filter_apps(struct tofi *tofi)
 {
 	struct entry *entry = &tofi->window.entry;
+	if (tofi->sort_results) {
+		return desktop_vec_filter(&entry->apps, &entry->query);
+	}
+	struct string_ref_vec results = string_ref_vec_create();
+	desktop_vec_filter_range(
+			&entry->apps,
+			0,
+			entry->apps.count,
+			&entry->query,
+			&results);
+	return results;
+}
+
+/*
+ * If results aren't being sorted, they stay in the same order as the
+ * commands, so we can stop filtering once we've got enough to show, and
+ * carry on later if needed.
+ */
+bool lazy_filtering(const struct tofi *tofi)
+{
+	return !tofi->sort_results && !tofi->window.entry.drun;
+}
+
+/*
+ * With lots of candidates, hand filtering off to the filter thread, so that
+ * we can carry on handling input and drawing in the meantime. Lazy filtering
+ * already only does a page's worth of work at a time, and there aren't
+ * enough apps in drun mode to be worth it, so those are left alone.
+ *
+ * Returns false if the results need working out here instead.
+ */
+bool filter_async(struct tofi *tofi)
+{
+	struct entry *entry = &tofi->window.entry;
+	if (!tofi->filter.started
+			|| entry->drun
+			|| lazy_filtering(tofi)
+			|| entry->commands.count < FILTER_THREAD_MIN_CANDIDATES) {
+		return false;
+	}
+	filter_thread_request(
+			&tofi->filter,
+			&entry->commands,
+			entry->input_utf8,
+			tofi->fuzzy_match,
+			tofi->path_match);
+	speculate_reset(tofi);
+	return true;
+}
+
+/*
+ * Carry on filtering the commands from where we left off, until there are at
+ * least count results or we run out of commands.
+ */
+void filter_more_results(struct tofi *tofi, size_t count)
+{
+	struct entry *entry = &tofi->window.entry;
+	while (entry->results.count < count && entry->filter_position < entry->commands.count) {
+		/*
+		 * Each command gives at most one result, so this will never
+		 * filter more than needed.
+		 */
+		size_t end = MIN(
+				entry->filter_position + count - entry->results.count,
+				entry->commands.count);
+		string_ref_vec_filter_range(
+				&entry->commands,
+				entry->filter_position,
+				end,
+				&entry->query,
+				&entry->results);
+		entry->filter_position = end;
+	}
+}
 
-	if (entry->input_utf32_length == 0) {
+uint32_t page_size(const struct entry *entry)
+{
+	if (entry->num_results > 0) {
+		return entry->num_results;
+	}
+	return MAX_AUTO_RESULTS;
+}
+
+/*
+ * Delete count characters before the cursor.
+ */
+void delete_character(struct tofi *tofi, uint32_t count)
+{
+	struct entry *entry = &tofi->window.entry;
+
+	if (entry->cursor_position == 0) {
 		/* No input to delete. */
 		return;
 	}
 
-	entry->input_utf32_length--;
-	entry->input_utf32[entry->input_utf32_length] = U'\0';
+	count = MIN(count, entry->cursor_position);
+	remove_characters(entry, entry->cursor_position - count, count);
 
 	input_refresh_results(tofi);
 }
 
-void delete_word(struct tofi *tofi)
+/*
+ * Delete count characters after the cursor.
+ */
+void delete_next_character(struct tofi *tofi, uint32_t count)
 {
 	struct entry *entry = &tofi->window.entry;
 
-	if (entry->input_utf32_length == 0) {
+	if (entry->cursor_position == entry->input_utf32_length) {
 		/* No input to delete. */
 		return;
 	}
 
-	while (entry->input_utf32_length > 0 && utf32_isspace(entry->input_utf32[entry->input_utf32_length - 1])) {
-		entry->input_utf32_length--;
+	count = MIN(count, entry->input_utf32_length - entry->cursor_position);
+	remove_characters(entry, entry->cursor_position, count);
+
+	input_refresh_results(tofi);
+}
+
+/*
+ * Delete count words before the cursor.
+ */
+void delete_word(struct tofi *tofi, uint32_t count)
+{
+	struct entry *entry = &tofi->window.entry;
+
+	if (entry->cursor_position == 0) {
+		/* No input to delete. */
+		return;
 	}
-	while (entry->input_utf32_length > 0 && !utf32_isspace(entry->input_utf32[entry->input_utf32_length - 1])) {
-		entry->input_utf32_length--;
+
+	uint32_t start = entry->cursor_position;
+	for (uint32_t i = 0; i < count && start > 0; i++) {
+		while (start > 0 && utf32_isspace(entry->input_utf32[start - 1])) {
+			start--;
+		}
+		while (start > 0 && !utf32_isspace(entry->input_utf32[start - 1])) {
+			start--;
+		}
 	}
-	entry->input_utf32[entry->input_utf32_length] = U'\0';
+	remove_characters(entry, start, entry->cursor_position - start);
 
 	input_refresh_results(tofi);
 }
 
+/*
+ * Remove count characters from the input, starting at start, moving the
+ * cursor along with the text after it. The UTF-8 input is left for
+ * input_refresh_results() to update.
+ */
+void remove_characters(struct entry *entry, uint32_t start, uint32_t count)
+{
+	memmove(&entry->input_utf32[start],
+			&entry->input_utf32[start + count],
+			(entry->input_utf32_length - start - count) * sizeof(entry->input_utf32[0]));
+	entry->input_utf32_length -= count;
+	entry->input_utf32[entry->input_utf32_length] = U'\0';
+	if (entry->cursor_position >= start + count) {
+		entry->cursor_position -= count;
+	} else {
+		entry->cursor_position = MIN(entry->cursor_position, start);
+	}
+}
+
 void clear_input(struct tofi *tofi)
 {
 	struct entry *entry = &tofi->window.entry;
 
 	entry->input_utf32_length = 0;
 	entry->input_utf32[0] = U'\0';
+	entry->cursor_position = 0;
 
 	input_refresh_results(tofi);
 }
 
+/*
+ * Moving the cursor doesn't change the input, so there's nothing to filter,
+ * just the cursor to redraw.
+ */
+void cursor_left(struct tofi *tofi, uint32_t count)
+{
+	struct entry *entry = &tofi->window.entry;
+	entry->cursor_position -= MIN(count, entry->cursor_position);
+}
+
+void cursor_right(struct tofi *tofi, uint32_t count)
+{
+	struct entry *entry = &tofi->window.entry;
+	entry->cursor_position += MIN(count, entry->input_utf32_length - entry->cursor_position);
+}
+
+void cursor_start(struct tofi *tofi)
+{
+	tofi->window.entry.cursor_position = 0;
+}
+
+void cursor_end(struct tofi *tofi)
+{
+	struct entry *entry = &tofi->window.entry;
+	entry->cursor_position = entry->input_utf32_length;
+}
+
 void paste(struct tofi *tofi)
 {
 	if (tofi->clipboard.wl_data_offer == NULL || tofi->clipboard.mime_type == NULL) {
@@ -261,6 +812,10 @@ void select_next_result(struct tofi *tofi)
 	entry->selection++;
 	if (entry->selection >= nsel) {
 		entry->selection -= nsel;
+		if (lazy_filtering(tofi)) {
+			/* Make sure the next page is there before moving to it. */
+			filter_more_results(tofi, entry->first_result + nsel + page_size(entry));
+		}
 		if (entry->results.count > 0) {
 			entry->first_result += nsel;
 			entry->first_result %= entry->results.count;
@@ -270,3 +825,42 @@ void select_next_result(struct tofi *tofi)
 		entry->last_num_results_drawn = entry->num_results_drawn;
 	}
 }
+
+/*
+ * Move the selection up by one, scrolling the results by a single row if
+ * it's already at the top.
+ */
+void scroll_up(struct tofi *tofi)
+{
+	struct entry *entry = &tofi->window.entry;
+
+	if (entry->selection > 0) {
+		entry->selection--;
+	} else if (entry->first_result > 0) {
+		entry->first_result--;
+	}
+}
+
+/*
+ * Move the selection down by one, scrolling the results by a single row if
+ * it's already at the bottom. Unlike select_next_result(), this stops at the
+ * last result rather than wrapping around.
+ */
+void scroll_down(struct tofi *tofi)
+{
+	struct entry *entry = &tofi->window.entry;
+
+	uint32_t nsel = MAX(MIN(entry->num_results_drawn, entry->results.count), 1);
+
+	if (entry->selection + 1 < nsel) {
+		entry->selection++;
+		return;
+	}
+	if (lazy_filtering(tofi)) {
+		filter_more_results(tofi, entry->first_result + nsel + 1);
+	}
+	if (entry->first_result + nsel < entry->results.count) {
+		entry->first_result++;
+	}
+	entry->last_num_results_drawn = entry->num_results_drawn;
+}
@@ -1,10 +1,49 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <xkbcommon/xkbcommon.h>
 #include "tofi.h"
 
+/*
+ * What a keypress does, independent of the keyboard layout and bindings.
+ * This is what gets recorded with TOFI_RECORD, and replayed by test/replay.c.
+ */
+enum input_action {
+	INPUT_ACTION_NONE,
+	INPUT_ACTION_ADD_CHARACTER,
+	INPUT_ACTION_DELETE_CHARACTER,
+	INPUT_ACTION_DELETE_WORD,
+	INPUT_ACTION_CLEAR,
+	INPUT_ACTION_PASTE,
+	INPUT_ACTION_SELECT_PREVIOUS,
+	INPUT_ACTION_SELECT_NEXT,
+	INPUT_ACTION_RESET_SELECTION,
+	INPUT_ACTION_CLOSE,
+	INPUT_ACTION_SUBMIT,
+	INPUT_ACTION_DELETE_NEXT_CHARACTER,
+	INPUT_ACTION_CURSOR_LEFT,
+	INPUT_ACTION_CURSOR_RIGHT,
+	INPUT_ACTION_CURSOR_START,
+	INPUT_ACTION_CURSOR_END,
+	INPUT_ACTION_SCROLL_UP,
+	INPUT_ACTION_SCROLL_DOWN
+};
+
+struct input_event {
+	enum input_action action;
+	/* The character to add, for INPUT_ACTION_ADD_CHARACTER. */
+	uint32_t character;
+};
+
 void input_handle_keypress(struct tofi *tofi, xkb_keycode_t keycode);
+void input_handle_repeat(struct tofi *tofi, xkb_keycode_t keycode, uint32_t count);
+void input_handle_scroll(struct tofi *tofi, int32_t steps);
+void input_apply(struct tofi *tofi, struct input_event event);
+void input_insert_text(struct tofi *tofi, const uint32_t *text, size_t length);
 void input_refresh_results(struct tofi *tofi);
+void input_take_results(struct tofi *tofi);
+void input_wait_results(struct tofi *tofi);
 
 #endif /* INPUT_H */
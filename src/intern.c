@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include "intern.h"
+#include "xmalloc.h"
+
+/*
+ * Strings are copied into blocks of this size, each just after its ID, rather
+ * than being allocated individually. Anything longer than a quarter of a
+ * block gets a block to itself, so that we don't waste the rest of the
+ * current one.
+ */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+#define INITIAL_TABLE_SIZE 1024
+
+struct arena_block {
+	struct arena_block *next;
+	size_t used;
+	size_t size;
+	char data[];
+};
+
+struct interned_string {
+	uint32_t hash;
+	const char *string;
+};
+
+/*
+ * The table is open-addressed with linear probing, and is kept at most half
+ * full. Its size is always a power of two.
+ */
+static struct {
+	mtx_t lock;
+	struct arena_block *blocks;
+	struct interned_string *table;
+	size_t count;
+	size_t size;
+} interner;
+
+static once_flag init_flag = ONCE_FLAG_INIT;
+
+static void intern_init(void)
+{
+	mtx_init(&interner.lock, mtx_plain);
+}
+
+/* FNV-1a, which also gives us the length for free. */
+static uint32_t hash_string(const char *str, size_t *len)
+{
+	uint32_t hash = 2166136261u;
+	const char *c = str;
+	while (*c != '\0') {
+		hash ^= (unsigned char)*c;
+		hash *= 16777619u;
+		c++;
+	}
+	*len = c - str;
+	return hash;
+}
+
+static const char *arena_copy(const char *str, size_t len, uint32_t id)
+{
+	/* Keep the IDs aligned. */
+	size_t size = sizeof(id) + len + 1;
+	size = (size + sizeof(id) - 1) & ~(sizeof(id) - 1);
+
+	struct arena_block *block = interner.blocks;
+	if (size > ARENA_BLOCK_SIZE / 4) {
+		block = xmalloc(sizeof(*block) + size);
+		block->used = size;
+		block->size = size;
+		if (interner.blocks == NULL) {
+			block->next = NULL;
+			interner.blocks = block;
+		} else {
+			/* Keep filling the current block. */
+			block->next = interner.blocks->next;
+			interner.blocks->next = block;
+		}
+		memcpy(block->data, &id, sizeof(id));
+		memcpy(block->data + sizeof(id), str, len + 1);
+		return block->data + sizeof(id);
+	}
+
+	if (block == NULL || block->size - block->used < size) {
+		block = xmalloc(sizeof(*block) + ARENA_BLOCK_SIZE);
+		block->next = interner.blocks;
+		block->used = 0;
+		block->size = ARENA_BLOCK_SIZE;
+		interner.blocks = block;
+	}
+	char *copy = &block->data[block->used];
+	memcpy(copy, &id, sizeof(id));
+	memcpy(copy + sizeof(id), str, len + 1);
+	block->used += size;
+	return copy + sizeof(id);
+}
+
+static void grow_table(void)
+{
+	size_t size = interner.size == 0 ? INITIAL_TABLE_SIZE : 2 * interner.size;
+	struct interned_string *table = xcalloc(size, sizeof(*table));
+	for (size_t i = 0; i < interner.size; i++) {
+		if (interner.table[i].string == NULL) {
+			continue;
+		}
+		size_t j = interner.table[i].hash & (size - 1);
+		while (table[j].string != NULL) {
+			j = (j + 1) & (size - 1);
+		}
+		table[j] = interner.table[i];
+	}
+	free(interner.table);
+	interner.table = table;
+	interner.size = size;
+}
+
+const char *intern(const char *str)
+{
+	call_once(&init_flag, intern_init);
+
+	size_t len;
+	uint32_t hash = hash_string(str, &len);
+
+	mtx_lock(&interner.lock);
+	if (2 * (interner.count + 1) > interner.size) {
+		grow_table();
+	}
+
+	size_t mask = interner.size - 1;
+	size_t i = hash & mask;
+	while (interner.table[i].string != NULL) {
+		if (interner.table[i].hash == hash && !strcmp(interner.table[i].string, str)) {
+			const char *res = interner.table[i].string;
+			mtx_unlock(&interner.lock);
+			return res;
+		}
+		i = (i + 1) & mask;
+	}
+
+	interner.table[i].hash = hash;
+	interner.table[i].string = arena_copy(str, len, interner.count);
+	interner.count++;
+	const char *res = interner.table[i].string;
+	mtx_unlock(&interner.lock);
+	return res;
+}
+
+uint32_t intern_id(const char *str)
+{
+	uint32_t id;
+	memcpy(&id, str - sizeof(id), sizeof(id));
+	return id;
+}
+
+size_t intern_count(void)
+{
+	call_once(&init_flag, intern_init);
+	mtx_lock(&interner.lock);
+	size_t count = interner.count;
+	mtx_unlock(&interner.lock);
+	return count;
+}
+
+void intern_destroy(void)
+{
+	call_once(&init_flag, intern_init);
+	mtx_lock(&interner.lock);
+	struct arena_block *block = interner.blocks;
+	while (block != NULL) {
+		struct arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+	free(interner.table);
+	interner.blocks = NULL;
+	interner.table = NULL;
+	interner.count = 0;
+	interner.size = 0;
+	mtx_unlock(&interner.lock);
+}
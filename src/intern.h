@@ -0,0 +1,33 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A process-wide table of strings, so that each distinct string is only
+ * stored once, however many places refer to it.
+ *
+ * Two interned strings are equal if and only if their pointers are, so they
+ * can be compared with == rather than strcmp(), and hashed by address.
+ * Interned strings live until intern_destroy() is called, so they mustn't be
+ * freed individually.
+ *
+ * Each interned string is also numbered, from 0 up in the order they were
+ * first interned, so that lookups keyed on them can use a plain array.
+ *
+ * This is safe to call from multiple threads.
+ */
+[[gnu::nonnull, gnu::returns_nonnull]]
+const char *intern(const char *str);
+
+/* The number of an interned string, which must have come from intern(). */
+[[gnu::nonnull]]
+uint32_t intern_id(const char *str);
+
+/* How many strings have been interned, i.e. one more than the highest ID. */
+size_t intern_count(void);
+
+void intern_destroy(void);
+
+#endif /* INTERN_H */
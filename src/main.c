@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <threads.h>
 #include <unistd.h>
@@ -20,13 +21,17 @@
 #include "entry.h"
 #include "image.h"
 #include "input.h"
+#include "intern.h"
 #include "log.h"
 #include "nelem.h"
 #include "lock.h"
 #include "shm.h"
+#include "recorder.h"
+#include "speculate.h"
 #include "string_vec.h"
 #include "string_vec.h"
 #include "unicode.h"
+#include "view_cache.h"
 #include "xmalloc.h"
 
 #undef MAX
@@ -37,6 +42,8 @@
 static const char *mime_type_text_plain = "text/plain";
 static const char *mime_type_text_plain_utf8 = "text/plain;charset=utf-8";
 
+static void finish_deferred_loading(struct tofi *tofi);
+
 static uint32_t gettime_ms() {
 	struct timespec t;
 	clock_gettime(CLOCK_MONOTONIC, &t);
@@ -73,11 +80,7 @@ static char *read_stdin(bool normalize) {
 		}
 	}
 	if (normalize) {
-		if (utf8_validate(buf)) {
-			char *tmp = utf8_normalize(buf);
-			free(buf);
-			buf = tmp;
-		} else {
+		if (!utf8_normalize_lines(&buf, strlen(buf))) {
 			log_error("Invalid UTF-8 in stdin.\n");
 		}
 	}
@@ -215,6 +218,7 @@ static void wl_keyboard_key(
 		tofi->repeat.keycode = keycode;
 		tofi->repeat.next = gettime_ms() + tofi->repeat.delay;
 	}
+	finish_deferred_loading(tofi);
 	input_handle_keypress(tofi, keycode);
 }
 
@@ -351,7 +355,18 @@ static void wl_pointer_axis_discrete(
 		enum wl_pointer_axis axis,
 		int32_t discrete)
 {
-	/* Deliberately left blank */
+	struct tofi *tofi = data;
+	if (axis != WL_POINTER_AXIS_VERTICAL_SCROLL) {
+		return;
+	}
+	/*
+	 * As with keypresses, the full list has to be loaded first, or
+	 * loading it would reset the selection we're about to move.
+	 */
+	finish_deferred_loading(tofi);
+
+	/* Each click of the mouse wheel scrolls by one result. */
+	input_handle_scroll(tofi, discrete);
 }
 
 static const struct wl_pointer_listener wl_pointer_listener = {
@@ -823,6 +838,7 @@ const struct option long_options[] = {
 	{"font-size", required_argument, NULL, 0},
 	{"font-features", required_argument, NULL, 0},
 	{"font-variations", required_argument, NULL, 0},
+	{"font-fallback", required_argument, NULL, 0},
 	{"num-results", required_argument, NULL, 0},
 	{"selection-color", required_argument, NULL, 0},
 	{"selection-match-color", required_argument, NULL, 0},
@@ -876,6 +892,8 @@ const struct option long_options[] = {
 	{"history", required_argument, NULL, 0},
 	{"history-file", required_argument, NULL, 0},
 	{"fuzzy-match", required_argument, NULL, 0},
+	{"path-match", required_argument, NULL, 0},
+	{"sort", required_argument, NULL, 0},
 	{"require-match", required_argument, NULL, 0},
 	{"hide-input", required_argument, NULL, 0},
 	{"hidden-character", required_argument, NULL, 0},
@@ -885,6 +903,7 @@ const struct option long_options[] = {
 	{"hint-font", required_argument, NULL, 0},
 	{"multi-instance", required_argument, NULL, 0},
 	{"ascii-input", required_argument, NULL, 0},
+	{"background-load", required_argument, NULL, 0},
 	{"output", required_argument, NULL, 0},
 	{"scale", required_argument, NULL, 0},
 	{"late-keyboard-init", optional_argument, NULL, 'k'},
@@ -957,11 +976,254 @@ static void parse_args(struct tofi *tofi, int argc, char *argv[])
 	}
 }
 
+/*
+ * Everything needed to load the list of commands for tofi-run or the list of
+ * apps for tofi-drun. This can be done on a separate thread, in which case
+ * fd becomes readable once loading is finished.
+ *
+ * If use_view is set, view holds the cached initial view, which is shown
+ * until loading is finished. If loading isn't happening in the background, it
+ * can then be put off entirely until the first keypress, which is what
+ * deferred is for.
+ */
+struct candidate_loader {
+	/* Inputs */
+	bool drun;
+	bool use_history;
+	bool fuzzy_match;
+	const char *history_file;
+	bool use_view;
+	char *view_buffer;
+	struct string_ref_vec view;
+	bool deferred;
+
+	/* Outputs */
+	char *command_buffer;
+	struct string_ref_vec commands;
+	struct desktop_vec apps;
+	struct history history;
+
+	thrd_t thread;
+	int fd;
+	bool active;
+};
+
+static struct history load_history(const struct candidate_loader *loader)
+{
+	if (loader->history_file[0] == 0) {
+		return history_load_default_file(loader->drun);
+	}
+	return history_load(loader->history_file);
+}
+
+static int load_candidates(void *data)
+{
+	struct candidate_loader *loader = data;
+
+	if (!loader->drun) {
+		log_debug("Generating command list.\n");
+		loader->command_buffer = compgen_cached();
+		struct string_ref_vec commands = string_ref_vec_from_buffer(loader->command_buffer);
+		if (loader->fuzzy_match) {
+			string_ref_vec_init_match_info(&commands);
+		}
+		if (loader->use_history) {
+			loader->history = load_history(loader);
+			loader->commands = compgen_history_sort(&commands, &loader->history);
+			string_ref_vec_destroy(&commands);
+		} else {
+			loader->commands = commands;
+		}
+		log_debug("Command list generated.\n");
+	} else {
+		log_debug("Generating desktop app list.\n");
+		struct desktop_vec apps = drun_generate_cached();
+		if (loader->use_history) {
+			loader->history = load_history(loader);
+			drun_history_sort(&apps, &loader->history);
+		}
+		struct string_ref_vec commands = string_ref_vec_create();
+		for (size_t i = 0; i < apps.count; i++) {
+			string_ref_vec_add(&commands, apps.buf[i].name);
+			commands.buf[i].history_score = apps.buf[i].history_score;
+		}
+		loader->commands = commands;
+		loader->apps = apps;
+		log_debug("App list generated.\n");
+	}
+
+	if (loader->active) {
+		uint64_t done = 1;
+		if (write(loader->fd, &done, sizeof(done)) != sizeof(done)) {
+			log_error("Failed to signal end of loading: %s\n", strerror(errno));
+		}
+	}
+	return 0;
+}
+
+/*
+ * Hand the loader's results over to the entry. The entry's existing lists,
+ * which are empty or hold the initial view, are destroyed.
+ */
+static void finish_loading(struct tofi *tofi, struct candidate_loader *loader)
+{
+	struct entry *entry = &tofi->window.entry;
+
+	if (loader->active) {
+		thrd_join(loader->thread, NULL);
+		close(loader->fd);
+		loader->active = false;
+	}
+
+	/*
+	 * The filter thread may still be looking at the old commands, and the
+	 * last frame drawn still refers to them.
+	 */
+	filter_thread_forget(&tofi->filter);
+	entry->harfbuzz.last_frame.valid = false;
+	group_cache_reset(&tofi->groups);
+
+	entry->command_buffer = loader->command_buffer;
+	string_ref_vec_destroy(&entry->commands);
+	entry->commands = loader->commands;
+	if (loader->drun) {
+		desktop_vec_destroy(&entry->apps);
+		entry->apps = loader->apps;
+	}
+	if (loader->use_history) {
+		history_destroy(&entry->history);
+		entry->history = loader->history;
+	}
+
+	/* This also applies anything typed while loading in the background. */
+	input_refresh_results(tofi);
+	recorder_source(&tofi->recorder, &entry->commands);
+
+	/* If the initial view has changed, update the cache for next time. */
+	if (loader->use_view) {
+		if (!view_cache_matches(&loader->view, &entry->commands)) {
+			log_debug("Updating initial view cache.\n");
+			view_cache_save(&entry->commands, loader->drun);
+		}
+		string_ref_vec_destroy(&loader->view);
+		free(loader->view_buffer);
+		loader->view_buffer = NULL;
+		loader->use_view = false;
+	}
+}
+
+/*
+ * If we've only got the cached initial view, load everything properly. This
+ * is called before handling each keypress, so the full ranking only happens
+ * once someone actually starts typing.
+ */
+static void finish_deferred_loading(struct tofi *tofi)
+{
+	struct candidate_loader *loader = tofi->deferred_loader;
+	if (loader == NULL) {
+		return;
+	}
+	tofi->deferred_loader = NULL;
+	loader->deferred = false;
+
+	log_debug("Loading deferred results.\n");
+	log_indent();
+	load_candidates(loader);
+	log_unindent();
+	finish_loading(tofi, loader);
+	speculate_reset(tofi);
+	tofi->window.surface.redraw = true;
+}
+
+/*
+ * Move the submitted entry up the ranked list of commands in the same way as
+ * history_add() does, and save the start of the list as the initial view for
+ * next time.
+ */
+static void save_initial_view(struct entry *entry, const char *selection)
+{
+	struct string_ref_vec *commands = &entry->commands;
+
+	/* The results refer to the same strings as commands. */
+	size_t from = 0;
+	while (from < commands->count && commands->buf[from].string != selection) {
+		from++;
+	}
+	if (from == commands->count) {
+		return;
+	}
+
+	struct scored_string_ref tmp = commands->buf[from];
+	tmp.history_score++;
+	size_t to = from;
+	while (to > 0 && tmp.history_score > commands->buf[to-1].history_score) {
+		to--;
+	}
+	memmove(&commands->buf[to+1], &commands->buf[to], (from - to) * sizeof(commands->buf[0]));
+	commands->buf[to] = tmp;
+
+	view_cache_save(commands, entry->drun);
+}
+
+/*
+ * Find the app with the given name. At this point, the list of apps is
+ * history sorted rather than alphabetically sorted, so we can't use
+ * desktop_vec_find_sorted().
+ */
+static struct desktop_entry *find_app(struct entry *entry, const char *name)
+{
+	for (size_t i = 0; i < entry->apps.count; i++) {
+		if (!strcmp(name, entry->apps.buf[i].name)) {
+			return &entry->apps.buf[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Keep track of the selected result, and once it's stayed the same for
+ * PREWARM_DELAY_MS, start loading it into the page cache.
+ */
+static void update_prewarm(struct tofi *tofi)
+{
+	struct prewarm *prewarm = &tofi->prewarm;
+	struct entry *entry = &tofi->window.entry;
+	if (!prewarm->started) {
+		return;
+	}
+
+	const char *selected = NULL;
+	uint32_t selection = entry->selection + entry->first_result;
+	if (selection < entry->results.count) {
+		selected = entry->results.buf[selection].string;
+	}
+	if (selected != prewarm->selected) {
+		prewarm->selected = selected;
+		prewarm->deadline = gettime_ms() + PREWARM_DELAY_MS;
+		prewarm->waiting = selected != NULL;
+		return;
+	}
+	if (!prewarm->waiting || (int32_t)(prewarm->deadline - gettime_ms()) > 0) {
+		return;
+	}
+	prewarm->waiting = false;
+
+	if (entry->drun) {
+		struct desktop_entry *app = find_app(entry, selected);
+		if (app != NULL) {
+			prewarm_request(prewarm, app->path, true);
+		}
+	} else {
+		prewarm_request(prewarm, selected, false);
+	}
+}
+
 static bool do_submit(struct tofi *tofi)
 {
 	struct entry *entry = &tofi->window.entry;
 	uint32_t selection = entry->selection + entry->first_result;
-	char *res = entry->results.buf[selection].string;
+	const char *res = entry->results.buf[selection].string;
+	const char *app_id = NULL;
 
 	if (tofi->window.entry.results.count == 0) {
 		/* Always require a match in drun mode. */
@@ -974,23 +1236,13 @@ static bool do_submit(struct tofi *tofi)
 	}
 
 	if (entry->drun) {
-		/*
-		 * At this point, the list of apps is history sorted rather
-		 * than alphabetically sorted, so we can't use
-		 * desktop_vec_find_sorted().
-		 */
-		struct desktop_entry *app = NULL;
-		for (size_t i = 0; i < entry->apps.count; i++) {
-			if (!strcmp(res, entry->apps.buf[i].name)) {
-				app = &entry->apps.buf[i];
-				break;
-			}
-		}
+		struct desktop_entry *app = find_app(entry, res);
 		if (app == NULL) {
 			log_error("Couldn't find application file! This shouldn't happen.\n");
 			return false;
 		}
-		char *path = app->path;
+		app_id = app->id;
+		const char *path = app->path;
 		if (tofi->drun_launch) {
 			drun_launch(path);
 		} else {
@@ -1000,11 +1252,12 @@ static bool do_submit(struct tofi *tofi)
 		printf("%s\n", res);
 	}
 	if (tofi->use_history) {
-		history_add(
-				&entry->history,
-				entry->results.buf[selection].string);
+		/* drun history is keyed by desktop file ID, see drun_history_sort(). */
+		history_add(&entry->history, entry->drun ? app_id : res);
 		if (tofi->history_file[0] == 0) {
+			/* Only possible in run or drun mode. */
 			history_save_default_file(&entry->history, entry->drun);
+			save_initial_view(entry, res);
 		} else {
 			history_save(&entry->history, tofi->history_file);
 		}
@@ -1020,7 +1273,11 @@ static void read_clipboard(struct tofi *tofi)
 	memset(buffer, 0, N_ELEM(buffer));
 	errno = 0;
 	bool eof = false;
-	while (entry->input_utf32_length < N_ELEM(entry->input_utf32)) {
+	/* The pasted text, which is inserted at the cursor all at once. */
+	uint32_t text[MAX_INPUT_LENGTH];
+	size_t length = 0;
+	size_t room = N_ELEM(entry->input_utf32) - 1 - entry->input_utf32_length;
+	while (length < room) {
 		for (size_t i = 0; i < 4; i++) {
 			/*
 			 * Read input 1 byte at a time. This is slow, but easy,
@@ -1042,7 +1299,8 @@ static void read_clipboard(struct tofi *tofi)
 					 * a character, but we should hit the
 					 * input length limit long before that.
 					 */
-					input_refresh_results(tofi);
+					recorder_text(&tofi->recorder, text, length);
+					input_insert_text(tofi, text, length);
 					tofi->window.surface.redraw = true;
 					return;
 				}
@@ -1058,8 +1316,8 @@ static void read_clipboard(struct tofi *tofi)
 				log_error("Invalid UTF-8 character in clipboard: %s\n", buffer);
 				break;
 			} else {
-				entry->input_utf32[entry->input_utf32_length] = unichar;
-				entry->input_utf32_length++;
+				text[length] = unichar;
+				length++;
 				break;
 			}
 		}
@@ -1068,11 +1326,11 @@ static void read_clipboard(struct tofi *tofi)
 			break;
 		}
 	}
-	entry->input_utf32[MIN(entry->input_utf32_length, N_ELEM(entry->input_utf32) - 1)] = U'\0';
 
 	clipboard_finish_paste(&tofi->clipboard);
 
-	input_refresh_results(tofi);
+	recorder_text(&tofi->recorder, text, length);
+	input_insert_text(tofi, text, length);
 	tofi->window.surface.redraw = true;
 }
 
@@ -1122,6 +1380,7 @@ int main(int argc, char *argv[])
 			| ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
 		.use_history = true,
 		.require_match = true,
+		.sort_results = true,
 		.use_scale = true,
 	};
 	wl_list_init(&tofi.output_list);
@@ -1241,7 +1500,7 @@ int main(int argc, char *argv[])
 		wl_surface_commit(surface.wl_surface);
 		wl_display_roundtrip(tofi.wl_display);
 		surface_init(&surface, tofi.wl_shm);
-		surface_draw(&surface);
+		surface_draw(&surface, NULL);
 		wl_display_roundtrip(tofi.wl_display);
 		surface_destroy(&surface);
 		zwlr_layer_surface_v1_destroy(zwlr_layer_surface);
@@ -1327,52 +1586,118 @@ int main(int argc, char *argv[])
 	 * If we were invoked as tofi-drun, generate the desktop app list.
 	 * Otherwise, just read standard input.
 	 */
-	if (strstr(argv[0], "-run")) {
-		log_debug("Generating command list.\n");
-		log_indent();
-		tofi.window.entry.command_buffer = compgen_cached();
-		struct string_ref_vec commands = string_ref_vec_from_buffer(tofi.window.entry.command_buffer);
-		if (tofi.use_history) {
-			if (tofi.history_file[0] == 0) {
-				tofi.window.entry.history = history_load_default_file(tofi.window.entry.drun);
+	struct candidate_loader loader = {
+		.drun = strstr(argv[0], "-run") == NULL
+			&& strstr(argv[0], "-drun") != NULL,
+		.use_history = tofi.use_history,
+		.fuzzy_match = tofi.fuzzy_match,
+		.history_file = tofi.history_file,
+		/*
+		 * The initial view depends on the history, so only use the
+		 * cache when it's the default history file.
+		 */
+		.use_view = tofi.use_history && tofi.history_file[0] == 0
+	};
+
+	/*
+	 * Keystrokes can be recorded for replaying later with test/replay,
+	 * e.g. to reproduce a slow session. Hidden input is likely to be a
+	 * password, so we never record that.
+	 */
+	if (getenv("TOFI_RECORD") != NULL && tofi.window.entry.hide_input) {
+		log_error("Not recording session, as hide-input is set.\n");
+	} else if (getenv("TOFI_RECORD") != NULL) {
+		const char *mode = "stdin";
+		if (strstr(argv[0], "-run") || strstr(argv[0], "-drun")) {
+			mode = loader.drun ? "drun" : "run";
+		}
+		recorder_open(
+				&tofi.recorder,
+				getenv("TOFI_RECORD"),
+				mode,
+				tofi.fuzzy_match,
+				tofi.path_match,
+				tofi.sort_results);
+	}
+
+	/*
+	 * With sorting on, each keystroke filters every candidate, so start
+	 * a thread to do that on. Whether it's actually used depends on how
+	 * many candidates there turn out to be.
+	 */
+	if (tofi.sort_results) {
+		filter_thread_start(&tofi.filter);
+	}
+
+	if (strstr(argv[0], "-run") || strstr(argv[0], "-drun")) {
+		/*
+		 * Only in run and drun modes do we know that results are
+		 * programs, so only then is it worth prewarming them.
+		 */
+		prewarm_start(&tofi.prewarm);
+
+		tofi.window.entry.drun = loader.drun;
+		tofi.window.entry.commands = string_ref_vec_create();
+		if (loader.drun) {
+			tofi.window.entry.apps = desktop_vec_create();
+		}
+		if (loader.use_view) {
+			loader.view_buffer = view_cache_load(loader.drun);
+			if (loader.view_buffer != NULL) {
+				log_debug("Using cached initial view.\n");
+				loader.view = string_ref_vec_from_buffer(loader.view_buffer);
+				loader.deferred = !tofi.background_load;
 			} else {
-				tofi.window.entry.history = history_load(tofi.history_file);
+				loader.view = string_ref_vec_create();
 			}
-			tofi.window.entry.commands = compgen_history_sort(&commands, &tofi.window.entry.history);
-			string_ref_vec_destroy(&commands);
+			tofi.window.entry.results = string_ref_vec_copy(&loader.view);
 		} else {
-			tofi.window.entry.commands = commands;
+			tofi.window.entry.results = string_ref_vec_create();
 		}
-		log_unindent();
-		log_debug("Command list generated.\n");
-	} else if (strstr(argv[0], "-drun")) {
-		log_debug("Generating desktop app list.\n");
-		log_indent();
-		tofi.window.entry.drun = true;
-		struct desktop_vec apps = drun_generate_cached();
-		if (tofi.use_history) {
-			if (tofi.history_file[0] == 0) {
-				tofi.window.entry.history = history_load_default_file(tofi.window.entry.drun);
+		/*
+		 * Until loading finishes, typing just narrows down the
+		 * results shown so far, which needs a query to start from.
+		 */
+		tofi.window.entry.query = query_compile("", tofi.fuzzy_match, tofi.path_match);
+		if (loader.deferred) {
+			/*
+			 * Just show the initial view for now, and put off
+			 * loading everything until the first keypress.
+			 */
+			tofi.deferred_loader = &loader;
+		} else if (tofi.background_load) {
+			/*
+			 * Start loading on another thread, and carry on
+			 * with an empty list. finish_loading() is then
+			 * called from the main loop.
+			 */
+			log_debug("Starting background load.\n");
+			loader.fd = eventfd(0, EFD_CLOEXEC);
+			if (loader.fd == -1) {
+				log_error("Failed to create eventfd: %s\n", strerror(errno));
 			} else {
-				tofi.window.entry.history = history_load(tofi.history_file);
-			}
-			if (tofi.window.entry.drun) {
-				drun_history_sort(&apps, &tofi.window.entry.history);
+				loader.active = true;
+				if (thrd_create(&loader.thread, load_candidates, &loader) != thrd_success) {
+					log_error("Failed to start loading thread.\n");
+					close(loader.fd);
+					loader.active = false;
+				}
 			}
 		}
-		struct string_ref_vec commands = string_ref_vec_create();
-		for (size_t i = 0; i < apps.count; i++) {
-			string_ref_vec_add(&commands, apps.buf[i].name);
+		if (!loader.active && !loader.deferred) {
+			log_indent();
+			load_candidates(&loader);
+			log_unindent();
+			finish_loading(&tofi, &loader);
 		}
-		tofi.window.entry.commands = commands;
-		tofi.window.entry.apps = apps;
-		log_unindent();
-		log_debug("App list generated.\n");
 	} else {
 		log_debug("Reading stdin.\n");
 		char *buf = read_stdin(!tofi.ascii_input);
 		tofi.window.entry.command_buffer = buf;
 		tofi.window.entry.commands = string_ref_vec_from_buffer(buf);
+		if (tofi.fuzzy_match) {
+			string_ref_vec_init_match_info(&tofi.window.entry.commands);
+		}
 		if (tofi.use_history) {
 			if (tofi.history_file[0] == 0) {
 				tofi.use_history = false;
@@ -1381,9 +1706,11 @@ int main(int argc, char *argv[])
 				string_ref_vec_history_sort(&tofi.window.entry.commands, &tofi.window.entry.history);
 			}
 		}
+		input_refresh_results(&tofi);
+		recorder_source(&tofi.recorder, &tofi.window.entry.commands);
 		log_debug("Result list generated.\n");
 	}
-	tofi.window.entry.results = string_ref_vec_copy(&tofi.window.entry.commands);
+	speculate_reset(&tofi);
 
 	/*
 	 * Next, we create the Wayland surface, which takes on the
@@ -1496,7 +1823,7 @@ int main(int argc, char *argv[])
 	log_debug("Renderer initialised.\n");
 
 	/* Perform an initial render. */
-	surface_draw(&tofi.window.surface);
+	surface_draw(&tofi.window.surface, NULL);
 
 	/*
 	 * entry_init() left the second of the two buffers we use for
@@ -1547,7 +1874,7 @@ int main(int argc, char *argv[])
 	 * order of the various functions called here.
 	 */
 	while (!tofi.closed) {
-		struct pollfd pollfds[2] = {{0}, {0}};
+		struct pollfd pollfds[4] = {{0}, {0}, {0}, {0}};
 		pollfds[0].fd = wl_display_get_fd(tofi.wl_display);
 
 		/* Make sure we're ready to receive events on the main queue. */
@@ -1575,33 +1902,69 @@ int main(int argc, char *argv[])
 			}
 		}
 
-		pollfds[0].events = POLLIN | POLLPRI;
-		int res;
-		if (tofi.clipboard.fd == 0) {
-			res = poll(&pollfds[0], 1, timeout);
-		} else {
-			/*
-			 * We're trying to paste from the clipboard, which is
-			 * done by reading from a pipe, so poll that file
-			 * descriptor as well.
-			 */
-			pollfds[1].fd = tofi.clipboard.fd;
-			pollfds[1].events = POLLIN | POLLPRI;
-			res = poll(pollfds, 2, timeout);
+		/*
+		 * If there's speculative filtering to be done, don't wait at
+		 * all, so that we can do a little whenever we're idle.
+		 */
+		bool speculating = speculate_pending(&tofi);
+		if (speculating) {
+			timeout = 0;
 		}
+
+		/* Wake up in time to prewarm the selected result. */
+		if (tofi.prewarm.waiting) {
+			int32_t wait = MAX((int32_t)(tofi.prewarm.deadline - gettime_ms()), 0);
+			if (timeout == -1 || wait < timeout) {
+				timeout = wait;
+			}
+		}
+
+		pollfds[0].events = POLLIN | POLLPRI;
+
+		/*
+		 * If we're trying to paste from the clipboard, which is done
+		 * by reading from a pipe, poll that file descriptor as well.
+		 * Negative file descriptors are ignored by poll().
+		 */
+		pollfds[1].fd = tofi.clipboard.fd == 0 ? -1 : tofi.clipboard.fd;
+		pollfds[1].events = POLLIN | POLLPRI;
+
+		/* Likewise if we're waiting for results to load. */
+		pollfds[2].fd = loader.active ? loader.fd : -1;
+		pollfds[2].events = POLLIN;
+
+		/* And for filtered results from the filter thread. */
+		pollfds[3].fd = tofi.filter.started ? tofi.filter.fd : -1;
+		pollfds[3].events = POLLIN;
+
+		int res = poll(pollfds, N_ELEM(pollfds), timeout);
 		if (res == 0) {
 			/*
 			 * No events to process and no error - we presumably
-			 * have a key repeat to handle.
+			 * have a key repeat to handle, or are idle.
 			 */
 			wl_display_cancel_read(tofi.wl_display);
+			bool repeated = false;
 			if (tofi.repeat.active) {
 				int64_t wait = (int64_t)tofi.repeat.next - (int64_t)gettime_ms();
 				if (wait <= 0) {
-					input_handle_keypress(&tofi, tofi.repeat.keycode);
-					tofi.repeat.next += 1000 / tofi.repeat.rate;
+					/*
+					 * If the last repeat took longer than
+					 * the repeat interval to handle, we've
+					 * missed some, so catch up in one go.
+					 * Any key release would have woken
+					 * poll(), so the key's still held.
+					 */
+					uint32_t interval = MAX(1000 / tofi.repeat.rate, 1);
+					uint32_t count = 1 - wait / interval;
+					input_handle_repeat(&tofi, tofi.repeat.keycode, count);
+					tofi.repeat.next += count * interval;
+					repeated = true;
 				}
 			}
+			if (speculating && !repeated) {
+				speculate_step(&tofi);
+			}
 		} else if (res < 0) {
 			/* There was an error polling the display. */
 			wl_display_cancel_read(tofi.wl_display);
@@ -1612,7 +1975,8 @@ int main(int argc, char *argv[])
 			} else {
 				/*
 				 * No events to read - we were woken up to
-				 * handle clipboard data.
+				 * handle clipboard data, loaded results or
+				 * filtered results.
 				 */
 				wl_display_cancel_read(tofi.wl_display);
 			}
@@ -1629,6 +1993,18 @@ int main(int argc, char *argv[])
 				 */
 				clipboard_finish_paste(&tofi.clipboard);
 			}
+			if (pollfds[2].revents & POLLIN) {
+				/*
+				 * Our results have finished loading, so apply
+				 * whatever's been typed so far.
+				 */
+				log_debug("Background load finished.\n");
+				finish_loading(&tofi, &loader);
+				tofi.window.surface.redraw = true;
+			}
+			if (pollfds[3].revents & POLLIN) {
+				input_take_results(&tofi);
+			}
 		}
 
 		/* Handle any events we read. */
@@ -1636,11 +2012,17 @@ int main(int argc, char *argv[])
 
 		if (tofi.window.surface.redraw) {
 			entry_update(&tofi.window.entry);
-			surface_draw(&tofi.window.surface);
+			surface_draw(&tofi.window.surface, &tofi.window.entry.image);
 			tofi.window.surface.redraw = false;
 		}
-		if (tofi.submit) {
+		update_prewarm(&tofi);
+		/*
+		 * If we're still loading results, leave any submission
+		 * pending until they arrive.
+		 */
+		if (tofi.submit && !loader.active) {
 			tofi.submit = false;
+			input_wait_results(&tofi);
 			if (do_submit(&tofi)) {
 				break;
 			}
@@ -1649,7 +2031,17 @@ int main(int argc, char *argv[])
 	}
 
 	log_debug("Window closed, performing cleanup.\n");
+	recorder_close(&tofi.recorder);
+	filter_thread_destroy(&tofi.filter);
 #ifdef DEBUG
+	prewarm_destroy(&tofi.prewarm);
+	if (loader.active) {
+		finish_loading(&tofi, &loader);
+	}
+	if (loader.deferred) {
+		string_ref_vec_destroy(&loader.view);
+		free(loader.view_buffer);
+	}
 	/*
 	 * For debug builds, try to cleanup as much as possible, to make using
 	 * e.g. Valgrind easier. There's still a few unavoidable leaks though,
@@ -1695,11 +2087,15 @@ int main(int argc, char *argv[])
 	if (tofi.window.entry.command_buffer != NULL) {
 		free(tofi.window.entry.command_buffer);
 	}
+	speculate_reset(&tofi);
+	group_cache_reset(&tofi.groups);
 	string_ref_vec_destroy(&tofi.window.entry.commands);
 	string_ref_vec_destroy(&tofi.window.entry.results);
+	query_destroy(&tofi.window.entry.query);
 	if (tofi.use_history) {
 		history_destroy(&tofi.window.entry.history);
 	}
+	intern_destroy();
 #endif
 	/*
 	 * For release builds, skip straight to display disconnection and quit.
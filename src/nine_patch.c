@@ -0,0 +1,127 @@
+#include <cairo/cairo.h>
+#include <math.h>
+#include <stddef.h>
+#include "nine_patch.h"
+
+static void rounded_rectangle(cairo_t *cr, uint32_t width, uint32_t height, uint32_t r)
+{
+	cairo_new_path(cr);
+
+	/* Top-left */
+	cairo_arc(cr, r, r, r, -M_PI, -M_PI_2);
+
+	/* Top-right */
+	cairo_arc(cr, width - r, r, r, -M_PI_2, 0);
+
+	/* Bottom-right */
+	cairo_arc(cr, width - r, height - r, r, 0, M_PI_2);
+
+	/* Bottom-left */
+	cairo_arc(cr, r, height - r, r, M_PI_2, M_PI);
+
+	cairo_close_path(cr);
+}
+
+/*
+ * Copy one r x r corner of our sprite to (x, y).
+ */
+static void draw_corner(
+		cairo_t *cr,
+		const struct nine_patch *patch,
+		double x,
+		double y,
+		double sprite_x,
+		double sprite_y)
+{
+	uint32_t r = patch->radius;
+	cairo_set_source_surface(cr, patch->corners, x - sprite_x, y - sprite_y);
+	cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+	cairo_rectangle(cr, x, y, r, r);
+	cairo_fill(cr);
+}
+
+void nine_patch_init(struct nine_patch *patch, struct color color, uint32_t radius)
+{
+	patch->color = color;
+	patch->radius = radius;
+	patch->corners = NULL;
+
+	if (radius == 0 || color.a == 0) {
+		/* Nothing to pre-render. */
+		return;
+	}
+
+	/*
+	 * The four corners of the rectangle are just the four quadrants of a
+	 * circle, so that's all we need to draw.
+	 */
+	patch->corners = cairo_image_surface_create(
+			CAIRO_FORMAT_ARGB32,
+			2 * radius,
+			2 * radius);
+	cairo_t *cr = cairo_create(patch->corners);
+	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+	cairo_arc(cr, radius, radius, radius, 0, 2 * M_PI);
+	cairo_fill(cr);
+	cairo_destroy(cr);
+	cairo_surface_flush(patch->corners);
+}
+
+void nine_patch_destroy(struct nine_patch *patch)
+{
+	if (patch->corners != NULL) {
+		cairo_surface_destroy(patch->corners);
+		patch->corners = NULL;
+	}
+}
+
+/*
+ * Draw a width x height rounded rectangle with its top-left corner at the
+ * current origin.
+ *
+ * The corners are copied straight from the pre-rendered sprite. The edges and
+ * centre of a nine-patch would normally be stretched from the sprite too, but
+ * as they're all a single solid color, we can just fill them as pixel-aligned
+ * rectangles, which Cairo handles with a simple fill loop.
+ */
+void nine_patch_draw(cairo_t *cr, const struct nine_patch *patch, uint32_t width, uint32_t height)
+{
+	struct color color = patch->color;
+	uint32_t r = patch->radius;
+
+	cairo_save(cr);
+	cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+
+	if (patch->corners == NULL || width < 2 * r || height < 2 * r) {
+		/*
+		 * Either there are no rounded corners, or the corners would
+		 * overlap, in which case we can't do any better than drawing
+		 * the path directly.
+		 */
+		rounded_rectangle(cr, width, height, r);
+		cairo_fill(cr);
+		cairo_restore(cr);
+		return;
+	}
+
+	/*
+	 * Our sprite can only be copied exactly if it's aligned to the pixel
+	 * grid, so snap to the nearest pixel.
+	 */
+	double x = 0;
+	double y = 0;
+	cairo_user_to_device(cr, &x, &y);
+	cairo_translate(cr, round(x) - x, round(y) - y);
+
+	cairo_rectangle(cr, r, 0, width - 2 * r, height);
+	cairo_rectangle(cr, 0, r, r, height - 2 * r);
+	cairo_rectangle(cr, width - r, r, r, height - 2 * r);
+	cairo_fill(cr);
+
+	draw_corner(cr, patch, 0, 0, 0, 0);
+	draw_corner(cr, patch, width - r, 0, r, 0);
+	draw_corner(cr, patch, 0, height - r, 0, r);
+	draw_corner(cr, patch, width - r, height - r, r, r);
+
+	cairo_restore(cr);
+}
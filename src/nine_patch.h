@@ -0,0 +1,22 @@
+#ifndef NINE_PATCH_H
+#define NINE_PATCH_H
+
+#include <cairo/cairo.h>
+#include <stdint.h>
+#include "color.h"
+
+/*
+ * A rounded rectangle of a fixed color and corner radius, pre-rendered so
+ * that it can be drawn at any size without rasterising a path.
+ */
+struct nine_patch {
+	cairo_surface_t *corners;
+	struct color color;
+	uint32_t radius;
+};
+
+void nine_patch_init(struct nine_patch *patch, struct color color, uint32_t radius);
+void nine_patch_destroy(struct nine_patch *patch);
+void nine_patch_draw(cairo_t *cr, const struct nine_patch *patch, uint32_t width, uint32_t height);
+
+#endif /* NINE_PATCH_H */
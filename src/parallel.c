@@ -0,0 +1,69 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+#include "log.h"
+#include "parallel.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+size_t split_lines(char *buffer, size_t length, struct chunk chunks[static MAX_CHUNKS])
+{
+	size_t num_chunks = 1;
+	if (length >= 2 * MIN_CHUNK_SIZE) {
+		long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (num_cpus > 1) {
+			num_chunks = MIN((size_t)num_cpus, length / MIN_CHUNK_SIZE);
+			num_chunks = MIN(num_chunks, MAX_CHUNKS);
+		}
+	}
+
+	size_t target = length / num_chunks;
+	size_t count = 0;
+	char *start = buffer;
+	char *end = buffer + length;
+	while (start < end) {
+		char *split = end;
+		if (count < num_chunks - 1 && (size_t)(end - start) > target) {
+			/* Round up to the end of the line we land in. */
+			char *newline = memchr(start + target, '\n', end - start - target);
+			if (newline != NULL) {
+				split = newline + 1;
+			}
+		}
+		chunks[count].start = start;
+		chunks[count].length = split - start;
+		count++;
+		start = split;
+	}
+	if (count == 0) {
+		chunks[0].start = buffer;
+		chunks[0].length = 0;
+		count = 1;
+	}
+	return count;
+}
+
+void run_parallel(int (*fn)(void *), void *args, size_t arg_size, size_t count)
+{
+	thrd_t threads[MAX_CHUNKS];
+	bool started[MAX_CHUNKS] = { false };
+	uint8_t *arg = args;
+
+	count = MIN(count, MAX_CHUNKS);
+	for (size_t i = 1; i < count; i++) {
+		started[i] = thrd_create(&threads[i], fn, arg + i * arg_size) == thrd_success;
+		if (!started[i]) {
+			log_error("Couldn't start worker thread.\n");
+		}
+	}
+	fn(arg);
+	for (size_t i = 1; i < count; i++) {
+		if (started[i]) {
+			thrd_join(threads[i], NULL);
+		} else {
+			fn(arg + i * arg_size);
+		}
+	}
+}
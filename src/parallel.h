@@ -0,0 +1,34 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+/*
+ * Helpers for splitting up big buffers of newline-separated text (e.g. from
+ * stdin), so that each core can work on its own piece.
+ */
+#define MAX_CHUNKS 16
+
+/* Below this size, a chunk isn't worth starting a thread for. */
+#define MIN_CHUNK_SIZE (1 << 20)
+
+struct chunk {
+	char *start;
+	size_t length;
+};
+
+/*
+ * Split buffer into at most MAX_CHUNKS chunks, one per core, each of which
+ * (apart from the last) ends just after a newline. Returns the number of
+ * chunks, which is 1 for small buffers.
+ */
+size_t split_lines(char *buffer, size_t length, struct chunk chunks[static MAX_CHUNKS]);
+
+/*
+ * Call fn on each of the count elements of the array args, each of size
+ * arg_size, in parallel. The first is handled on the calling thread, and
+ * any that a thread can't be started for are too.
+ */
+void run_parallel(int (*fn)(void *), void *args, size_t arg_size, size_t count);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,387 @@
+#include <elf.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "drun.h"
+#include "log.h"
+#include "prewarm.h"
+#include "string_vec.h"
+
+/*
+ * Don't follow libraries forever, e.g. for something linked against half of
+ * KDE. Anything this far down is very likely already cached anyway.
+ */
+#define MAX_FILES 128
+#define MAX_DEPTH 4
+
+struct prewarm_state {
+	/* Where to look for libraries, from /etc/ld.so.conf and defaults. */
+	struct string_vec lib_dirs;
+	/* Library names we've already warmed for the current target. */
+	struct string_vec seen;
+};
+
+static void warm_file(struct prewarm_state *state, const char *path, uint8_t depth);
+
+static void add_lib_dirs_from(struct string_vec *dirs, const char *filename, uint8_t depth)
+{
+	FILE *fp = fopen(filename, "rbe");
+	if (fp == NULL) {
+		return;
+	}
+	char line[PATH_MAX];
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+		line[strcspn(line, "\r\n")] = '\0';
+		char *start = line + strspn(line, " \t");
+		if (strncmp(start, "include", 7) == 0 && (start[7] == ' ' || start[7] == '\t')) {
+			/* Includes are globs of more config files. */
+			char *pattern = start + 7 + strspn(start + 7, " \t");
+			glob_t matches;
+			if (depth < MAX_DEPTH && glob(pattern, 0, NULL, &matches) == 0) {
+				for (size_t i = 0; i < matches.gl_pathc; i++) {
+					add_lib_dirs_from(dirs, matches.gl_pathv[i], depth + 1);
+				}
+				globfree(&matches);
+			}
+		} else if (start[0] == '/') {
+			start[strcspn(start, " \t")] = '\0';
+			string_vec_add(dirs, start);
+		}
+	}
+	fclose(fp);
+}
+
+/*
+ * Find library name in the same way as the dynamic linker, near enough.
+ * Returns false if we can't find it.
+ */
+static bool find_library(
+		const struct prewarm_state *state,
+		const char *name,
+		const char *runpath,
+		char path[static PATH_MAX])
+{
+	if (strchr(name, '/') != NULL) {
+		snprintf(path, PATH_MAX, "%s", name);
+		return access(path, R_OK) == 0;
+	}
+
+	/* $ORIGIN and friends aren't worth handling here. */
+	if (runpath != NULL && strchr(runpath, '$') == NULL) {
+		const char *dir = runpath;
+		while (*dir != '\0') {
+			size_t len = strcspn(dir, ":");
+			if (len > 0 && snprintf(path, PATH_MAX, "%.*s/%s", (int)len, dir, name) < PATH_MAX
+					&& access(path, R_OK) == 0) {
+				return true;
+			}
+			dir += len;
+			if (*dir == ':') {
+				dir++;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < state->lib_dirs.count; i++) {
+		if (snprintf(path, PATH_MAX, "%s/%s", state->lib_dirs.buf[i].string, name) < PATH_MAX
+				&& access(path, R_OK) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Translate a virtual address in an ELF file to an offset in the file,
+ * using its loadable segments. Returns 0 if it's not in any of them.
+ */
+static size_t vaddr_to_offset(const Elf64_Phdr *phdrs, size_t num_phdrs, uint64_t vaddr)
+{
+	for (size_t i = 0; i < num_phdrs; i++) {
+		const Elf64_Phdr *ph = &phdrs[i];
+		if (ph->p_type == PT_LOAD && vaddr >= ph->p_vaddr && vaddr - ph->p_vaddr < ph->p_filesz) {
+			return vaddr - ph->p_vaddr + ph->p_offset;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Warm each of the libraries an ELF file needs. Only native 64-bit files are
+ * handled, which covers everything tofi will realistically be launching.
+ * Every offset is checked, as the file could be anything.
+ */
+static void warm_needed(struct prewarm_state *state, const uint8_t *data, size_t size, uint8_t depth)
+{
+	if (size < sizeof(Elf64_Ehdr) || memcmp(data, ELFMAG, SELFMAG) != 0) {
+		return;
+	}
+	const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)data;
+	if (ehdr->e_ident[EI_CLASS] != ELFCLASS64
+			|| ehdr->e_phentsize != sizeof(Elf64_Phdr)
+			|| ehdr->e_phoff > size
+			|| (size - ehdr->e_phoff) / sizeof(Elf64_Phdr) < ehdr->e_phnum) {
+		return;
+	}
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (ehdr->e_ident[EI_DATA] != ELFDATA2LSB) {
+		return;
+	}
+#else
+	if (ehdr->e_ident[EI_DATA] != ELFDATA2MSB) {
+		return;
+	}
+#endif
+
+	const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(data + ehdr->e_phoff);
+	const Elf64_Dyn *dyn = NULL;
+	size_t num_dyn = 0;
+	for (size_t i = 0; i < ehdr->e_phnum; i++) {
+		if (phdrs[i].p_type == PT_DYNAMIC
+				&& phdrs[i].p_offset <= size
+				&& phdrs[i].p_filesz <= size - phdrs[i].p_offset) {
+			dyn = (const Elf64_Dyn *)(data + phdrs[i].p_offset);
+			num_dyn = phdrs[i].p_filesz / sizeof(Elf64_Dyn);
+			break;
+		}
+	}
+	if (dyn == NULL) {
+		/* Statically linked. */
+		return;
+	}
+
+	size_t strtab = 0;
+	size_t strsz = 0;
+	for (size_t i = 0; i < num_dyn && dyn[i].d_tag != DT_NULL; i++) {
+		if (dyn[i].d_tag == DT_STRTAB) {
+			strtab = vaddr_to_offset(phdrs, ehdr->e_phnum, dyn[i].d_un.d_ptr);
+		} else if (dyn[i].d_tag == DT_STRSZ) {
+			strsz = dyn[i].d_un.d_val;
+		}
+	}
+	if (strtab == 0 || strtab >= size || strsz > size - strtab) {
+		return;
+	}
+	const char *strings = (const char *)(data + strtab);
+
+	const char *runpath = NULL;
+	for (size_t i = 0; i < num_dyn && dyn[i].d_tag != DT_NULL; i++) {
+		if ((dyn[i].d_tag == DT_RUNPATH || dyn[i].d_tag == DT_RPATH)
+				&& dyn[i].d_un.d_val < strsz
+				&& memchr(&strings[dyn[i].d_un.d_val], '\0', strsz - dyn[i].d_un.d_val) != NULL) {
+			runpath = &strings[dyn[i].d_un.d_val];
+		}
+	}
+
+	for (size_t i = 0; i < num_dyn && dyn[i].d_tag != DT_NULL; i++) {
+		if (dyn[i].d_tag != DT_NEEDED || dyn[i].d_un.d_val >= strsz) {
+			continue;
+		}
+		const char *name = &strings[dyn[i].d_un.d_val];
+		if (memchr(name, '\0', strsz - dyn[i].d_un.d_val) == NULL) {
+			continue;
+		}
+		bool seen = false;
+		for (size_t j = 0; j < state->seen.count; j++) {
+			if (strcmp(state->seen.buf[j].string, name) == 0) {
+				seen = true;
+				break;
+			}
+		}
+		if (seen || state->seen.count >= MAX_FILES) {
+			continue;
+		}
+		string_vec_add(&state->seen, name);
+
+		char path[PATH_MAX];
+		if (find_library(state, name, runpath, path)) {
+			warm_file(state, path, depth + 1);
+		}
+	}
+}
+
+/*
+ * Ask the kernel to read the whole of path into the page cache, followed by
+ * any libraries it needs.
+ */
+void warm_file(struct prewarm_state *state, const char *path, uint8_t depth)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return;
+	}
+
+	/*
+	 * readahead() waits for the reads to be queued, which is fine here.
+	 * Some filesystems don't support it, so fall back to just advising.
+	 */
+	if (readahead(fd, 0, st.st_size) == -1) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	}
+
+	if (depth < MAX_DEPTH) {
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			warm_needed(state, data, st.st_size, depth);
+			munmap(data, st.st_size);
+		}
+	}
+	close(fd);
+}
+
+/*
+ * Find command in PATH, as the shell would. Returns false if it's not there.
+ */
+static bool find_command(const char *command, char path[static PATH_MAX])
+{
+	if (command[0] == '\0') {
+		return false;
+	}
+	if (strchr(command, '/') != NULL) {
+		snprintf(path, PATH_MAX, "%s", command);
+		return true;
+	}
+
+	const char *dir = getenv("PATH");
+	if (dir == NULL) {
+		return false;
+	}
+	while (*dir != '\0') {
+		size_t len = strcspn(dir, ":");
+		if (len > 0 && snprintf(path, PATH_MAX, "%.*s/%s", (int)len, dir, command) < PATH_MAX
+				&& access(path, X_OK) == 0) {
+			return true;
+		}
+		dir += len;
+		if (*dir == ':') {
+			dir++;
+		}
+	}
+	return false;
+}
+
+static void prewarm_target(struct prewarm_state *state, const char *target, bool desktop_file)
+{
+	char path[PATH_MAX];
+	if (desktop_file) {
+		char *command = drun_executable(target);
+		if (command == NULL) {
+			return;
+		}
+		bool found = find_command(command, path);
+		free(command);
+		if (!found) {
+			return;
+		}
+	} else {
+		/* In run mode, the result may have arguments. */
+		char command[PATH_MAX];
+		snprintf(command, sizeof(command), "%s", target);
+		command[strcspn(command, " \t")] = '\0';
+		if (!find_command(command, path)) {
+			return;
+		}
+	}
+
+	string_vec_destroy(&state->seen);
+	state->seen = string_vec_create();
+	warm_file(state, path, 0);
+}
+
+static int prewarm_thread(void *arg)
+{
+	struct prewarm *prewarm = arg;
+	struct prewarm_state state;
+	state.seen = string_vec_create();
+
+	state.lib_dirs = string_vec_create();
+	add_lib_dirs_from(&state.lib_dirs, "/etc/ld.so.conf", 0);
+	const char *default_dirs[] = { "/lib64", "/usr/lib64", "/lib", "/usr/lib" };
+	for (size_t i = 0; i < sizeof(default_dirs) / sizeof(default_dirs[0]); i++) {
+		string_vec_add(&state.lib_dirs, default_dirs[i]);
+	}
+
+	char target[PATH_MAX];
+	char last[PATH_MAX] = { 0 };
+	mtx_lock(&prewarm->lock);
+	while (true) {
+		while (!prewarm->pending && !prewarm->quit) {
+			cnd_wait(&prewarm->cond, &prewarm->lock);
+		}
+		if (prewarm->quit) {
+			break;
+		}
+		memcpy(target, prewarm->target, sizeof(target));
+		bool desktop_file = prewarm->desktop_file;
+		prewarm->pending = false;
+		mtx_unlock(&prewarm->lock);
+
+		/* Going back to something we've just done is pointless. */
+		if (strcmp(target, last) != 0) {
+			prewarm_target(&state, target, desktop_file);
+			memcpy(last, target, sizeof(last));
+		}
+
+		mtx_lock(&prewarm->lock);
+	}
+	mtx_unlock(&prewarm->lock);
+
+	string_vec_destroy(&state.seen);
+	string_vec_destroy(&state.lib_dirs);
+	return 0;
+}
+
+void prewarm_start(struct prewarm *prewarm)
+{
+	mtx_init(&prewarm->lock, mtx_plain);
+	cnd_init(&prewarm->cond);
+	if (thrd_create(&prewarm->thread, prewarm_thread, prewarm) != thrd_success) {
+		log_error("Failed to start prewarm thread.\n");
+		mtx_destroy(&prewarm->lock);
+		cnd_destroy(&prewarm->cond);
+		return;
+	}
+	prewarm->started = true;
+}
+
+void prewarm_destroy(struct prewarm *prewarm)
+{
+	if (!prewarm->started) {
+		return;
+	}
+	mtx_lock(&prewarm->lock);
+	prewarm->quit = true;
+	cnd_signal(&prewarm->cond);
+	mtx_unlock(&prewarm->lock);
+	thrd_join(prewarm->thread, NULL);
+	mtx_destroy(&prewarm->lock);
+	cnd_destroy(&prewarm->cond);
+	prewarm->started = false;
+}
+
+void prewarm_request(struct prewarm *prewarm, const char *target, bool desktop_file)
+{
+	if (!prewarm->started) {
+		return;
+	}
+	mtx_lock(&prewarm->lock);
+	snprintf(prewarm->target, sizeof(prewarm->target), "%s", target);
+	prewarm->desktop_file = desktop_file;
+	prewarm->pending = true;
+	cnd_signal(&prewarm->cond);
+	mtx_unlock(&prewarm->lock);
+}
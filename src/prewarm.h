@@ -0,0 +1,51 @@
+#ifndef PREWARM_H
+#define PREWARM_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <threads.h>
+
+/*
+ * How long the selection has to stay put before we prewarm it, so that
+ * scrolling through the results doesn't set off lots of disk reads.
+ */
+#define PREWARM_DELAY_MS 150
+
+/*
+ * Most of the time it takes a program to start from cold is spent faulting
+ * in its executable and libraries from disk. We usually know what's going to
+ * be run well before Enter is pressed, so once the selection has settled,
+ * a background thread finds the selected program and its libraries, and asks
+ * the kernel to start reading them into the page cache.
+ *
+ * Everything here is best effort, and failures are silently ignored.
+ */
+struct prewarm {
+	thrd_t thread;
+	mtx_t lock;
+	cnd_t cond;
+	bool started;
+	bool quit;
+
+	/* The newest request, guarded by lock. */
+	char target[PATH_MAX];
+	bool desktop_file;
+	bool pending;
+
+	/* The selected result, and when to prewarm it, for the main thread. */
+	const char *selected;
+	uint32_t deadline;
+	bool waiting;
+};
+
+void prewarm_start(struct prewarm *prewarm);
+void prewarm_destroy(struct prewarm *prewarm);
+
+/*
+ * Prewarm target, which is either a command to look up in PATH, or the path
+ * of a desktop file if desktop_file is set.
+ */
+void prewarm_request(struct prewarm *prewarm, const char *target, bool desktop_file);
+
+#endif /* PREWARM_H */
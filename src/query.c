@@ -0,0 +1,371 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "fuzzy_match.h"
+#include "query.h"
+#include "unicode.h"
+#include "xmalloc.h"
+
+#undef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static void parse_term(struct query_term *term, char *word, bool fuzzy);
+static int32_t match_term(
+		const struct query_term *restrict term,
+		const char *restrict str,
+		const struct match_info *restrict info);
+
+struct query query_compile(const char *input, bool fuzzy, bool path)
+{
+	struct query query = {
+		.path = path,
+		.plain = true
+	};
+
+	query.buffer = utf8_normalize(input);
+	if (query.buffer == NULL) {
+		query.buffer = xstrdup(input);
+	}
+
+	/* Terms are separated by spaces, so there can't be more than this. */
+	size_t max_terms = strlen(query.buffer) / 2 + 1;
+	query.terms = xcalloc(max_terms, sizeof(*query.terms));
+	query.groups = xcalloc(max_terms, sizeof(*query.groups));
+
+	size_t num_terms = 0;
+	bool join = false;
+	char *saveptr = NULL;
+	char *word = strtok_r(query.buffer, " ", &saveptr);
+	while (word != NULL) {
+		if (!strcmp(word, "|")) {
+			/* Join the next term to the previous group. */
+			join = query.num_groups > 0;
+			query.plain = false;
+			word = strtok_r(NULL, " ", &saveptr);
+			continue;
+		}
+
+		struct query_term *term = &query.terms[num_terms];
+		num_terms++;
+		parse_term(term, word, fuzzy);
+		if (term->pattern != word
+				|| term->negate
+				|| term->type != (fuzzy ? QUERY_TERM_FUZZY : QUERY_TERM_SUBSTRING)) {
+			/* There was an operator. */
+			query.plain = false;
+		}
+
+		/*
+		 * Terms are stored in order, so this term is always just
+		 * after the last term of the previous group.
+		 */
+		struct query_group *group;
+		if (join) {
+			group = &query.groups[query.num_groups - 1];
+			group->count++;
+			group->cost = MAX(group->cost, term->type);
+		} else {
+			group = &query.groups[query.num_groups];
+			query.num_groups++;
+			group->terms = term;
+			group->count = 1;
+			group->cost = term->type;
+		}
+		join = false;
+
+		word = strtok_r(NULL, " ", &saveptr);
+	}
+
+	/*
+	 * Put the cheapest groups first. This is an insertion sort, as there
+	 * are only ever a few groups, and it keeps the order of equal ones.
+	 */
+	for (size_t i = 1; i < query.num_groups; i++) {
+		struct query_group tmp = query.groups[i];
+		size_t j = i;
+		while (j > 0 && tmp.cost < query.groups[j-1].cost) {
+			query.groups[j] = query.groups[j-1];
+			j--;
+		}
+		query.groups[j] = tmp;
+	}
+
+	return query;
+}
+
+void query_destroy(struct query *query)
+{
+	free(query->buffer);
+	free(query->terms);
+	free(query->groups);
+}
+
+/*
+ * Strip any operators from word, and fill in term. Operators on their own
+ * (e.g. a lone "^") are treated as plain text.
+ */
+static void parse_term(struct query_term *term, char *word, bool fuzzy)
+{
+	term->type = fuzzy ? QUERY_TERM_FUZZY : QUERY_TERM_SUBSTRING;
+	term->negate = false;
+
+	if (word[0] == '!' && word[1] != '\0') {
+		term->negate = true;
+		/* As in fzf, negated words are never fuzzy. */
+		term->type = QUERY_TERM_SUBSTRING;
+		word++;
+	}
+
+	size_t len = strlen(word);
+	if (word[0] == '\'' && len > 1) {
+		term->type = QUERY_TERM_SUBSTRING;
+		word++;
+		len--;
+	} else {
+		bool prefix = false;
+		if (word[0] == '^' && len > 1) {
+			prefix = true;
+			word++;
+			len--;
+		}
+		if (word[len - 1] == '$' && len > 1) {
+			word[len - 1] = '\0';
+			len--;
+			term->type = prefix ? QUERY_TERM_EQUAL : QUERY_TERM_SUFFIX;
+		} else if (prefix) {
+			term->type = QUERY_TERM_PREFIX;
+		}
+	}
+
+	term->pattern = word;
+	term->length = len;
+	term->ascii = true;
+	term->caseless = true;
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = word[i];
+		if (c > 127) {
+			term->ascii = false;
+			term->caseless = false;
+			break;
+		}
+		if (isalpha(c)) {
+			term->caseless = false;
+		}
+	}
+}
+
+/*
+ * Match query against str, returning the total score, or INT32_MIN if it
+ * doesn't match.
+ *
+ * In path-match mode, basename is the offset of the last component of str,
+ * which is tried first, so that long directories don't count against a match.
+ * info is for the whole of str, and may be NULL.
+ */
+int32_t query_match(
+		const struct query *restrict query,
+		const char *restrict str,
+		uint32_t basename,
+		const struct match_info *restrict info)
+{
+	int32_t score = 0;
+	for (size_t i = 0; i < query->num_groups; i++) {
+		int32_t group_score = query_match_group(
+				query,
+				&query->groups[i],
+				str,
+				basename,
+				info);
+		if (group_score == INT32_MIN) {
+			/* No need to look any further. */
+			return INT32_MIN;
+		}
+		score += group_score;
+	}
+	return score;
+}
+
+/*
+ * Like query_match(), but for something with two fields to search, such as
+ * an app's name and its keywords. Each term matches if it matches either
+ * field (preferring str), and a negated term only if neither field contains
+ * it. used_alt is set if any term only matched alt.
+ */
+int32_t query_match_either(
+		const struct query *restrict query,
+		const char *restrict str,
+		const struct match_info *restrict info,
+		const char *restrict alt,
+		bool *restrict used_alt)
+{
+	*used_alt = false;
+	int32_t score = 0;
+	for (size_t i = 0; i < query->num_groups; i++) {
+		const struct query_group *group = &query->groups[i];
+		int32_t best_score = INT32_MIN;
+		bool best_alt = false;
+		for (size_t j = 0; j < group->count; j++) {
+			const struct query_term *term = &group->terms[j];
+			int32_t term_score = match_term(term, str, info);
+			bool term_alt = false;
+			if (term_score == INT32_MIN) {
+				term_score = match_term(term, alt, NULL);
+				term_alt = true;
+			}
+			if (term->negate) {
+				term_score = term_score == INT32_MIN ? 0 : INT32_MIN;
+				term_alt = false;
+			}
+			if (term_score > best_score) {
+				best_score = term_score;
+				best_alt = term_alt;
+			}
+		}
+		if (best_score == INT32_MIN) {
+			return INT32_MIN;
+		}
+		*used_alt = *used_alt || best_alt;
+		score += best_score;
+	}
+	return score;
+}
+
+/*
+ * Match a single group of query against str, returning the score of its best
+ * matching term, or INT32_MIN if none of them match. The total score of a
+ * query is just the sum of these.
+ */
+int32_t query_match_group(
+		const struct query *restrict query,
+		const struct query_group *restrict group,
+		const char *restrict str,
+		uint32_t basename,
+		const struct match_info *restrict info)
+{
+	int32_t best_score = INT32_MIN;
+	for (size_t j = 0; j < group->count; j++) {
+		const struct query_term *term = &group->terms[j];
+		int32_t term_score = INT32_MIN;
+		if (query->path && basename > 0 && !term->negate && term->type != QUERY_TERM_SUFFIX) {
+			term_score = match_term(term, str + basename, NULL);
+		}
+		if (term_score == INT32_MIN) {
+			term_score = match_term(term, str, info);
+		}
+		if (term->negate) {
+			term_score = term_score == INT32_MIN ? 0 : INT32_MIN;
+		}
+		best_score = MAX(best_score, term_score);
+	}
+	return best_score;
+}
+
+/*
+ * Case-insensitively check whether str starts with the term's pattern,
+ * returning a pointer to just past the match, or NULL if it doesn't.
+ */
+static const char *match_prefix(const struct query_term *restrict term, const char *restrict str)
+{
+	if (term->caseless) {
+		return strncmp(str, term->pattern, term->length) ? NULL : str + term->length;
+	}
+	if (term->ascii) {
+		return strncasecmp(str, term->pattern, term->length) ? NULL : str + term->length;
+	}
+	const char *p = term->pattern;
+	const char *s = str;
+	while (*p != '\0') {
+		if (*s == '\0') {
+			return NULL;
+		}
+		if (utf32_tolower(utf8_to_utf32(s)) != utf32_tolower(utf8_to_utf32(p))) {
+			return NULL;
+		}
+		s = utf8_next_char(s);
+		p = utf8_next_char(p);
+	}
+	return s;
+}
+
+/*
+ * Case-insensitively check whether str ends with the term's pattern.
+ */
+static bool match_suffix(const struct query_term *restrict term, const char *restrict str)
+{
+	size_t len = strlen(str);
+	if (term->ascii) {
+		/*
+		 * If this lands in the middle of a multi-byte character, the
+		 * comparison will just fail, as ASCII bytes never appear
+		 * there.
+		 */
+		if (len < term->length) {
+			return false;
+		}
+		const char *s = str + len - term->length;
+		if (term->caseless) {
+			return !strcmp(s, term->pattern);
+		}
+		return !strcasecmp(s, term->pattern);
+	}
+	const char *p = term->pattern + term->length;
+	const char *s = str + len;
+	while (p > term->pattern) {
+		if (s == str) {
+			return false;
+		}
+		p = utf8_prev_char(p);
+		s = utf8_prev_char(s);
+		if (utf32_tolower(utf8_to_utf32(s)) != utf32_tolower(utf8_to_utf32(p))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Case-insensitively find the term's pattern in str. The byte-wise searches
+ * are much faster than utf8_strcasestr(), which has to casefold both strings.
+ */
+static const char *find_substring(const struct query_term *restrict term, const char *restrict str)
+{
+	if (term->caseless) {
+		return strstr(str, term->pattern);
+	}
+	if (term->ascii) {
+		return strcasestr(str, term->pattern);
+	}
+	return utf8_strcasestr(str, term->pattern);
+}
+
+/*
+ * Score a single term against str. The scores match those of
+ * fuzzy_match_words() and fuzzy_match_simple_words(), with anchored matches
+ * scoring as well as a substring match at the start of str.
+ */
+static int32_t match_term(
+		const struct query_term *restrict term,
+		const char *restrict str,
+		const struct match_info *restrict info)
+{
+	switch (term->type) {
+		case QUERY_TERM_EQUAL:
+			{
+				const char *end = match_prefix(term, str);
+				return (end != NULL && *end == '\0') ? 0 : INT32_MIN;
+			}
+		case QUERY_TERM_PREFIX:
+			return match_prefix(term, str) != NULL ? 0 : INT32_MIN;
+		case QUERY_TERM_SUFFIX:
+			return match_suffix(term, str) ? 0 : INT32_MIN;
+		case QUERY_TERM_SUBSTRING:
+			{
+				const char *c = find_substring(term, str);
+				return c != NULL ? str - c : INT32_MIN;
+			}
+		case QUERY_TERM_FUZZY:
+			return fuzzy_match(term->pattern, str, info);
+	}
+	return INT32_MIN;
+}
@@ -0,0 +1,92 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "fuzzy_match.h"
+
+/*
+ * A search query, parsed once per keystroke rather than once per candidate.
+ *
+ * The input is split on spaces into terms, all of which must match. As in
+ * fzf, terms can be modified by a few operators:
+ *
+ *   'word   substring match
+ *   ^word   prefix match
+ *   word$   suffix match
+ *   ^word$  exact match
+ *   !word   inverse substring match (also !^word, !word$, !^word$)
+ *   a | b   either a or b
+ *
+ * Plain words are fuzzy or substring matched depending on fuzzy-match.
+ *
+ * Groups of alternatives are ordered so that the cheapest checks are done
+ * first, and matching stops as soon as a group fails. Term types are listed
+ * here in that order.
+ */
+enum query_term_type {
+	QUERY_TERM_EQUAL,
+	QUERY_TERM_PREFIX,
+	QUERY_TERM_SUFFIX,
+	QUERY_TERM_SUBSTRING,
+	QUERY_TERM_FUZZY
+};
+
+struct query_term {
+	enum query_term_type type;
+	bool negate;
+	/* Whether the pattern is all ASCII, and if so whether it has any letters. */
+	bool ascii;
+	bool caseless;
+	const char *pattern;
+	size_t length;
+};
+
+struct query_group {
+	struct query_term *terms;
+	size_t count;
+	enum query_term_type cost;
+};
+
+struct query {
+	char *buffer;
+	struct query_term *terms;
+	struct query_group *groups;
+	size_t num_groups;
+	bool path;
+	/*
+	 * Whether the query is just plain words. Adding a character to a plain
+	 * query can only remove results, so the current results can be
+	 * narrowed down rather than filtering everything again. Operators
+	 * break that, e.g. "!fo" to "!foo".
+	 */
+	bool plain;
+};
+
+[[nodiscard("memory leaked")]]
+struct query query_compile(const char *input, bool fuzzy, bool path);
+
+void query_destroy(struct query *query);
+
+int32_t query_match(
+		const struct query *restrict query,
+		const char *restrict str,
+		uint32_t basename,
+		const struct match_info *restrict info);
+
+int32_t query_match_either(
+		const struct query *restrict query,
+		const char *restrict str,
+		const struct match_info *restrict info,
+		const char *restrict alt,
+		bool *restrict used_alt);
+
+int32_t query_match_group(
+		const struct query *restrict query,
+		const struct query_group *restrict group,
+		const char *restrict str,
+		uint32_t basename,
+		const struct match_info *restrict info);
+
+#endif /* QUERY_H */
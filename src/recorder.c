@@ -0,0 +1,163 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include "input.h"
+#include "log.h"
+#include "nelem.h"
+#include "recorder.h"
+#include "string_vec.h"
+
+static const char *event_names[] = {
+	[INPUT_ACTION_NONE] = "none",
+	[INPUT_ACTION_ADD_CHARACTER] = "char",
+	[INPUT_ACTION_DELETE_CHARACTER] = "delete-char",
+	[INPUT_ACTION_DELETE_WORD] = "delete-word",
+	[INPUT_ACTION_CLEAR] = "clear",
+	[INPUT_ACTION_PASTE] = "paste",
+	[INPUT_ACTION_SELECT_PREVIOUS] = "previous",
+	[INPUT_ACTION_SELECT_NEXT] = "next",
+	[INPUT_ACTION_RESET_SELECTION] = "home",
+	[INPUT_ACTION_CLOSE] = "close",
+	[INPUT_ACTION_SUBMIT] = "submit",
+	[INPUT_ACTION_DELETE_NEXT_CHARACTER] = "delete-next-char",
+	[INPUT_ACTION_CURSOR_LEFT] = "cursor-left",
+	[INPUT_ACTION_CURSOR_RIGHT] = "cursor-right",
+	[INPUT_ACTION_CURSOR_START] = "cursor-start",
+	[INPUT_ACTION_CURSOR_END] = "cursor-end",
+	[INPUT_ACTION_SCROLL_UP] = "scroll-up",
+	[INPUT_ACTION_SCROLL_DOWN] = "scroll-down"
+};
+
+static uint64_t elapsed_us(const struct recorder *recorder)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - recorder->start.tv_sec) * 1000000
+		+ (now.tv_nsec - recorder->start.tv_nsec) / 1000;
+}
+
+void recorder_open(
+		struct recorder *recorder,
+		const char *path,
+		const char *mode,
+		bool fuzzy_match,
+		bool path_match,
+		bool sort_results)
+{
+	/*
+	 * A recording is a keystroke log, including anything pasted, so
+	 * make sure only we can read it, as with the history file.
+	 */
+	errno = 0;
+	recorder->file = NULL;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd != -1) {
+		recorder->file = fdopen(fd, "wb");
+		if (recorder->file == NULL) {
+			close(fd);
+		}
+	}
+	if (recorder->file == NULL) {
+		log_error("Couldn't open recording file \"%s\": %s\n", path, strerror(errno));
+		return;
+	}
+	log_debug("Recording session to %s.\n", path);
+
+	/*
+	 * Flush every line, so that we've still got the recording if tofi
+	 * is killed, or crashes.
+	 */
+	setvbuf(recorder->file, NULL, _IOLBF, 0);
+	clock_gettime(CLOCK_MONOTONIC, &recorder->start);
+
+	fprintf(recorder->file, "tofi-recording 1\n");
+	fprintf(recorder->file, "mode %s\n", mode);
+	fprintf(recorder->file, "options %d %d %d\n", fuzzy_match, path_match, sort_results);
+}
+
+void recorder_close(struct recorder *recorder)
+{
+	if (recorder->file != NULL) {
+		fclose(recorder->file);
+		recorder->file = NULL;
+	}
+}
+
+/*
+ * Record which candidates we're searching. This may come after some events,
+ * if the candidates are loaded in the background.
+ */
+void recorder_source(struct recorder *recorder, const struct string_ref_vec *candidates)
+{
+	if (recorder->file == NULL) {
+		return;
+	}
+	fprintf(recorder->file, "source %zu %016" PRIx64 "\n",
+			candidates->count,
+			recorder_fingerprint(candidates));
+}
+
+void recorder_event(struct recorder *recorder, const struct input_event *event)
+{
+	if (recorder->file == NULL) {
+		return;
+	}
+	fprintf(recorder->file, "%" PRIu64 " %s", elapsed_us(recorder), recorder_event_name(event));
+	if (event->action == INPUT_ACTION_ADD_CHARACTER) {
+		fprintf(recorder->file, " %" PRIx32, event->character);
+	}
+	fputc('\n', recorder->file);
+}
+
+void recorder_text(struct recorder *recorder, const uint32_t *text, size_t length)
+{
+	if (recorder->file == NULL || length == 0) {
+		return;
+	}
+	fprintf(recorder->file, "%" PRIu64 " text", elapsed_us(recorder));
+	for (size_t i = 0; i < length; i++) {
+		fprintf(recorder->file, " %" PRIx32, text[i]);
+	}
+	fputc('\n', recorder->file);
+}
+
+/* 64-bit FNV-1a over every candidate, each followed by a newline. */
+uint64_t recorder_fingerprint(const struct string_ref_vec *candidates)
+{
+	uint64_t hash = 14695981039346656037u;
+	for (size_t i = 0; i < candidates->count; i++) {
+		for (const char *c = candidates->buf[i].string; *c != '\0'; c++) {
+			hash ^= (unsigned char)*c;
+			hash *= 1099511628211u;
+		}
+		hash ^= '\n';
+		hash *= 1099511628211u;
+	}
+	return hash;
+}
+
+const char *recorder_event_name(const struct input_event *event)
+{
+	if ((size_t)event->action >= N_ELEM(event_names)) {
+		return event_names[INPUT_ACTION_NONE];
+	}
+	return event_names[event->action];
+}
+
+/*
+ * Fill in event's action from its recorded name, returning false if it isn't
+ * one we know.
+ */
+bool recorder_parse_event(const char *name, struct input_event *event)
+{
+	for (size_t i = 0; i < N_ELEM(event_names); i++) {
+		if (!strcmp(name, event_names[i])) {
+			event->action = i;
+			event->character = 0;
+			return true;
+		}
+	}
+	return false;
+}
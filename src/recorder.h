@@ -0,0 +1,53 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+struct input_event;
+struct string_ref_vec;
+
+/*
+ * Records a session to a file, for replaying with test/replay.c.
+ *
+ * Recording is enabled by setting TOFI_RECORD to the path of a file to write.
+ * The file is plain text, one line per record:
+ *
+ *   tofi-recording 1
+ *   mode <run|drun|stdin>
+ *   options <fuzzy-match> <path-match> <sort>
+ *   source <candidate count> <fingerprint>
+ *   <time> <event> [<character>...]
+ *
+ * Times are in microseconds since recording started, and characters are
+ * hexadecimal codepoints. Events are named as in event_names in recorder.c,
+ * with the extra event "text" for text that's arrived from the clipboard.
+ *
+ * The fingerprint is a hash of the candidates in order, so that a replay can
+ * tell whether it's seeing the same list as the recording.
+ */
+struct recorder {
+	FILE *file;
+	struct timespec start;
+};
+
+void recorder_open(
+		struct recorder *recorder,
+		const char *path,
+		const char *mode,
+		bool fuzzy_match,
+		bool path_match,
+		bool sort_results);
+void recorder_close(struct recorder *recorder);
+void recorder_source(struct recorder *recorder, const struct string_ref_vec *candidates);
+void recorder_event(struct recorder *recorder, const struct input_event *event);
+void recorder_text(struct recorder *recorder, const uint32_t *text, size_t length);
+
+uint64_t recorder_fingerprint(const struct string_ref_vec *candidates);
+const char *recorder_event_name(const struct input_event *event);
+bool recorder_parse_event(const char *name, struct input_event *event);
+
+#endif /* RECORDER_H */
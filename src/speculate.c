@@ -0,0 +1,270 @@
+#include <string.h>
+#include "log.h"
+#include "nelem.h"
+#include "speculate.h"
+#include "tofi.h"
+#include "unicode.h"
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+ * How many candidates to filter per step. This should be small enough that
+ * a step finishes well within a frame, so that real input is never delayed
+ * noticeably.
+ */
+#define CHUNK_SIZE 1024
+
+/*
+ * Below this many candidates, filtering is fast enough that there's no point
+ * speculating.
+ */
+#define MIN_CANDIDATES 2048
+
+/* How many history entries and results to look at for predictions. */
+#define MAX_HISTORY_PREDICTIONS 16
+#define MAX_RESULT_PREDICTIONS 32
+
+struct prediction {
+	uint32_t character;
+	uint32_t weight;
+};
+
+static void add_prediction(
+		struct prediction *predictions,
+		size_t *count,
+		size_t max,
+		uint32_t character,
+		uint32_t weight)
+{
+	for (size_t i = 0; i < *count; i++) {
+		if (predictions[i].character == character) {
+			predictions[i].weight += weight;
+			return;
+		}
+	}
+	if (*count < max) {
+		predictions[*count].character = character;
+		predictions[*count].weight = weight;
+		(*count)++;
+	}
+}
+
+/*
+ * Return the character that follows the current input in str, or 0 if the
+ * input isn't found. Matching is case-insensitive, and the returned character
+ * is lowercase, as that's what's most likely to be typed.
+ */
+static uint32_t next_character(const struct entry *entry, const char *str, bool prefix)
+{
+	const char *match = str;
+	if (entry->input_utf8_length > 0) {
+		match = utf8_strcasestr(str, entry->input_utf8);
+		if (match == NULL || (prefix && match != str)) {
+			return 0;
+		}
+		match += entry->input_utf8_length;
+	}
+	if (*match == '\0') {
+		return 0;
+	}
+	uint32_t ch = utf32_tolower(utf8_to_utf32(match));
+	if (!utf32_isprint(ch)) {
+		return 0;
+	}
+	return ch;
+}
+
+static void free_speculations(struct speculator *spec)
+{
+	for (size_t i = 0; i < spec->count; i++) {
+		if (spec->buf[i].results.buf != NULL) {
+			string_ref_vec_destroy(&spec->buf[i].results);
+		}
+		query_destroy(&spec->buf[i].compiled);
+	}
+	spec->count = 0;
+}
+
+/*
+ * Guess which characters are most likely to be typed next.
+ *
+ * The best source of predictions is the history, as the user is likely to be
+ * typing something they've run before. After that, the current results are
+ * already ranked by search and history score, so the characters that follow
+ * the input in the top few are good guesses too.
+ */
+static void predict(struct tofi *tofi)
+{
+	struct entry *entry = &tofi->window.entry;
+	struct speculator *spec = &tofi->speculator;
+
+	if (!tofi->sort_results) {
+		/* Filtering is already lazy, so there's nothing to gain. */
+		return;
+	}
+	if (entry->drun) {
+		/*
+		 * There are never enough apps for filtering them to be
+		 * slow, and they're filtered all at once anyway.
+		 */
+		return;
+	}
+	if (entry->results.count < MIN_CANDIDATES) {
+		return;
+	}
+	if (entry->input_utf32_length >= N_ELEM(entry->input_utf32) - 1) {
+		/* No room for another character anyway. */
+		return;
+	}
+	if (entry->cursor_position != entry->input_utf32_length) {
+		/* We only ever guess what's typed at the end. */
+		return;
+	}
+	if (!entry->query.plain) {
+		/* Operators mean we can't just narrow down the results. */
+		return;
+	}
+
+	struct prediction predictions[MAX_HISTORY_PREDICTIONS + MAX_RESULT_PREDICTIONS];
+	size_t count = 0;
+
+	size_t num_history = MIN(entry->history.count, MAX_HISTORY_PREDICTIONS);
+	for (size_t i = 0; i < num_history; i++) {
+		uint32_t ch = next_character(entry, entry->history.buf[i].name, true);
+		if (ch != 0) {
+			/* History is sorted by run count, so favour the first. */
+			add_prediction(predictions, &count, N_ELEM(predictions), ch, 2 * (MAX_HISTORY_PREDICTIONS - i));
+		}
+	}
+
+	size_t num_results = MIN(entry->results.count, MAX_RESULT_PREDICTIONS);
+	for (size_t i = 0; i < num_results; i++) {
+		uint32_t ch = next_character(entry, entry->results.buf[i].string, false);
+		if (ch != 0) {
+			add_prediction(predictions, &count, N_ELEM(predictions), ch, MAX_RESULT_PREDICTIONS - i);
+		}
+	}
+
+	/* Keep the most likely few. */
+	for (size_t n = 0; n < MAX_SPECULATIONS && n < count; n++) {
+		size_t best = n;
+		for (size_t i = n + 1; i < count; i++) {
+			if (predictions[i].weight > predictions[best].weight) {
+				best = i;
+			}
+		}
+		struct prediction tmp = predictions[n];
+		predictions[n] = predictions[best];
+		predictions[best] = tmp;
+
+		struct speculation *s = &spec->buf[spec->count];
+		s->character = predictions[n].character;
+		s->progress = 0;
+		s->done = false;
+		s->results = string_ref_vec_create();
+		memcpy(s->query, entry->input_utf8, entry->input_utf8_length);
+		uint8_t len = utf32_to_utf8(s->character, &s->query[entry->input_utf8_length]);
+		s->query[entry->input_utf8_length + len] = '\0';
+		s->compiled = query_compile(s->query, tofi->fuzzy_match, tofi->path_match);
+		if (!s->compiled.plain) {
+			/*
+			 * We'd be narrowing down the current results, which
+			 * only works for plain words, e.g. "!fo" to "!foo".
+			 */
+			query_destroy(&s->compiled);
+			string_ref_vec_destroy(&s->results);
+			continue;
+		}
+		spec->count++;
+	}
+}
+
+/*
+ * Throw away any speculations, as the input or results have changed.
+ * New ones will be made the next time we're idle.
+ */
+void speculate_reset(struct tofi *tofi)
+{
+	free_speculations(&tofi->speculator);
+	tofi->speculator.stale = true;
+}
+
+/*
+ * Return whether there's any speculative work left to do.
+ */
+bool speculate_pending(const struct tofi *tofi)
+{
+	const struct speculator *spec = &tofi->speculator;
+	if (filter_thread_busy(&tofi->filter)) {
+		/*
+		 * The current results are out of date, so there's nothing
+		 * useful to guess from yet.
+		 */
+		return false;
+	}
+	if (spec->stale) {
+		return true;
+	}
+	for (size_t i = 0; i < spec->count; i++) {
+		if (!spec->buf[i].done) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Do a small amount of speculative filtering. This should only be called
+ * when there's nothing better to do.
+ */
+void speculate_step(struct tofi *tofi)
+{
+	struct entry *entry = &tofi->window.entry;
+	struct speculator *spec = &tofi->speculator;
+
+	if (spec->stale) {
+		spec->stale = false;
+		predict(tofi);
+		return;
+	}
+
+	for (size_t i = 0; i < spec->count; i++) {
+		struct speculation *s = &spec->buf[i];
+		if (s->done) {
+			continue;
+		}
+		/*
+		 * This mirrors what add_character() does for plain words,
+		 * narrowing down the current results.
+		 */
+		size_t total = entry->results.count;
+		size_t end = MIN(s->progress + CHUNK_SIZE, total);
+		string_ref_vec_filter_range(&entry->results, s->progress, end, &s->compiled, &s->results);
+		s->progress = end;
+		if (s->progress == total) {
+			string_ref_vec_sort_by_score(&s->results);
+			s->done = true;
+			log_debug("Speculated %zu results for \"%s\".\n", s->results.count, s->query);
+		}
+		return;
+	}
+}
+
+/*
+ * If we've already worked out the results for the next character being
+ * `character`, move them into results and return true.
+ */
+bool speculate_take(struct tofi *tofi, uint32_t character, struct string_ref_vec *results)
+{
+	struct speculator *spec = &tofi->speculator;
+	for (size_t i = 0; i < spec->count; i++) {
+		struct speculation *s = &spec->buf[i];
+		if (s->done && s->character == character) {
+			*results = s->results;
+			s->results.buf = NULL;
+			return true;
+		}
+	}
+	return false;
+}
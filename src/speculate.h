@@ -0,0 +1,37 @@
+#ifndef SPECULATE_H
+#define SPECULATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "entry.h"
+#include "query.h"
+#include "string_vec.h"
+
+#define MAX_SPECULATIONS 4
+
+struct tofi;
+
+/*
+ * The results we'd get if the next character typed was `character`.
+ */
+struct speculation {
+	uint32_t character;
+	char query[4 * MAX_INPUT_LENGTH + 5];
+	struct query compiled;
+	size_t progress;
+	bool done;
+	struct string_ref_vec results;
+};
+
+struct speculator {
+	struct speculation buf[MAX_SPECULATIONS];
+	uint8_t count;
+	bool stale;
+};
+
+void speculate_reset(struct tofi *tofi);
+bool speculate_pending(const struct tofi *tofi);
+void speculate_step(struct tofi *tofi);
+bool speculate_take(struct tofi *tofi, uint32_t character, struct string_ref_vec *results);
+
+#endif /* SPECULATE_H */
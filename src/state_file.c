@@ -0,0 +1,281 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <threads.h>
+#include <unistd.h>
+#include "cache_file.h"
+#include "log.h"
+#include "state_file.h"
+#include "xmalloc.h"
+
+static const char magic[8] = "tofi-st1";
+static const char *default_cache_dir = ".cache";
+static const char *state_basename = "tofi-state";
+
+struct section_header {
+	uint32_t id;
+	uint32_t padding;
+	uint64_t stamp;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct mapping {
+	const uint8_t *data;
+	size_t size;
+};
+
+/*
+ * The file is mapped the first time it's needed, which may be from the
+ * loading thread, and stays mapped until we exit. lock guards the current
+ * mapping, and writing the file.
+ */
+static once_flag init_flag = ONCE_FLAG_INIT;
+static struct mapping state;
+static mtx_t lock;
+
+#define HEADER_SIZE (sizeof(magic) + 2 * sizeof(uint32_t))
+#define ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+[[nodiscard("memory leaked")]]
+static char *get_state_path() {
+	char *state_name = NULL;
+	const char *cache_path = getenv("XDG_CACHE_HOME");
+	if (cache_path == NULL) {
+		const char *home = getenv("HOME");
+		if (home == NULL) {
+			log_error("Couldn't retrieve HOME from environment.\n");
+			return NULL;
+		}
+		size_t len = strlen(home) + 1
+			+ strlen(default_cache_dir) + 1
+			+ strlen(state_basename) + 1;
+		state_name = xmalloc(len);
+		snprintf(
+			state_name,
+			len,
+			"%s/%s/%s",
+			home,
+			default_cache_dir,
+			state_basename);
+	} else {
+		size_t len = strlen(cache_path) + 1
+			+ strlen(state_basename) + 1;
+		state_name = xmalloc(len);
+		snprintf(
+			state_name,
+			len,
+			"%s/%s",
+			cache_path,
+			state_basename);
+	}
+	return state_name;
+}
+
+/*
+ * Map the state file at filename, returning an empty mapping if it's missing
+ * or invalid.
+ */
+static struct mapping map_state_file(const char *filename)
+{
+	struct mapping mapping = { .data = NULL, .size = 0 };
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return mapping;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (size_t)st.st_size < HEADER_SIZE) {
+		close(fd);
+		return mapping;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return mapping;
+	}
+
+	/* Check the section table, so nothing else has to. */
+	uint32_t num_sections;
+	memcpy(&num_sections, (uint8_t *)data + sizeof(magic), sizeof(num_sections));
+	bool valid = memcmp(data, magic, sizeof(magic)) == 0
+		&& num_sections <= STATE_FILE_MAX_SECTIONS
+		&& HEADER_SIZE + num_sections * sizeof(struct section_header) <= (size_t)st.st_size;
+	for (uint32_t i = 0; valid && i < num_sections; i++) {
+		struct section_header section;
+		memcpy(&section, (uint8_t *)data + HEADER_SIZE + i * sizeof(section), sizeof(section));
+		valid = section.offset <= (uint64_t)st.st_size
+			&& section.size <= (uint64_t)st.st_size - section.offset;
+	}
+	if (!valid) {
+		log_error("State file \"%s\" is corrupt, ignoring.\n", filename);
+		munmap(data, st.st_size);
+		return mapping;
+	}
+
+	mapping.data = data;
+	mapping.size = st.st_size;
+	return mapping;
+}
+
+static uint32_t num_sections(const struct mapping *mapping)
+{
+	if (mapping->data == NULL) {
+		return 0;
+	}
+	uint32_t count;
+	memcpy(&count, mapping->data + sizeof(magic), sizeof(count));
+	return count;
+}
+
+static struct section_header get_section(const struct mapping *mapping, uint32_t i)
+{
+	struct section_header section;
+	memcpy(&section, mapping->data + HEADER_SIZE + i * sizeof(section), sizeof(section));
+	return section;
+}
+
+static void state_file_init(void)
+{
+	mtx_init(&lock, mtx_plain);
+	char *filename = get_state_path();
+	if (filename == NULL) {
+		return;
+	}
+	state = map_state_file(filename);
+	free(filename);
+}
+
+/*
+ * Find section id in the current mapping, with any stamp if any_stamp is set.
+ */
+static const char *find_section(enum state_section id, uint64_t stamp, bool any_stamp, size_t *size)
+{
+	call_once(&init_flag, state_file_init);
+	const char *data = NULL;
+	mtx_lock(&lock);
+	for (uint32_t i = 0; i < num_sections(&state); i++) {
+		struct section_header section = get_section(&state, i);
+		if (section.id == id && (any_stamp || section.stamp == stamp)) {
+			*size = section.size;
+			data = (const char *)state.data + section.offset;
+			break;
+		}
+	}
+	mtx_unlock(&lock);
+	return data;
+}
+
+const char *state_file_get(enum state_section id, uint64_t stamp, size_t *size)
+{
+	return find_section(id, stamp, false, size);
+}
+
+const char *state_file_get_stale(enum state_section id, size_t *size)
+{
+	return find_section(id, 0, true, size);
+}
+
+void state_file_reload(void)
+{
+	call_once(&init_flag, state_file_init);
+	char *filename = get_state_path();
+	if (filename == NULL) {
+		return;
+	}
+	/* The old mapping is kept, as sections from it may still be in use. */
+	struct mapping mapping = map_state_file(filename);
+	free(filename);
+	mtx_lock(&lock);
+	state = mapping;
+	mtx_unlock(&lock);
+}
+
+int state_file_lock_section(enum state_section id, bool wait)
+{
+	char *filename = get_state_path();
+	if (filename == NULL) {
+		return -1;
+	}
+	size_t len = strlen(filename) + 16;
+	char *section_name = xmalloc(len);
+	snprintf(section_name, len, "%s.%d", filename, (int)id);
+	int fd = cache_lock(section_name, wait);
+	free(section_name);
+	free(filename);
+	return fd;
+}
+
+void state_file_set(enum state_section id, uint64_t stamp, const void *data, size_t size)
+{
+	call_once(&init_flag, state_file_init);
+	char *filename = get_state_path();
+	if (filename == NULL) {
+		return;
+	}
+	mtx_lock(&lock);
+
+	/*
+	 * Start from whatever's on disk now rather than what we mapped at
+	 * startup, so that we don't undo another update in the meantime,
+	 * and hold the lock so nobody else does the same to us.
+	 */
+	int fd = cache_lock(filename, true);
+	struct mapping old = map_state_file(filename);
+	struct section_header sections[STATE_FILE_MAX_SECTIONS];
+	const uint8_t *contents[STATE_FILE_MAX_SECTIONS];
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < num_sections(&old); i++) {
+		struct section_header section = get_section(&old, i);
+		if (section.id != id && count < STATE_FILE_MAX_SECTIONS - 1) {
+			contents[count] = old.data + section.offset;
+			sections[count] = section;
+			count++;
+		}
+	}
+	sections[count] = (struct section_header){ .id = id, .stamp = stamp, .size = size };
+	contents[count] = data;
+	count++;
+
+	size_t total = ALIGN(HEADER_SIZE + count * sizeof(struct section_header));
+	for (uint32_t i = 0; i < count; i++) {
+		sections[i].offset = total;
+		sections[i].padding = 0;
+		total += ALIGN(sections[i].size);
+	}
+
+	uint8_t *buf = xcalloc(total, 1);
+	memcpy(buf, magic, sizeof(magic));
+	memcpy(buf + sizeof(magic), &count, sizeof(count));
+	memcpy(buf + HEADER_SIZE, sections, count * sizeof(struct section_header));
+	for (uint32_t i = 0; i < count; i++) {
+		memcpy(buf + sections[i].offset, contents[i], sections[i].size);
+	}
+	if (old.data != NULL) {
+		munmap((void *)old.data, old.size);
+	}
+
+	cache_write(filename, buf, total);
+	cache_unlock(fd);
+
+	mtx_unlock(&lock);
+	free(buf);
+	free(filename);
+}
+
+uint64_t state_file_stamp(uint64_t stamp, const void *data, size_t size)
+{
+	/* 64-bit FNV-1a. */
+	const uint8_t *bytes = data;
+	if (stamp == 0) {
+		stamp = UINT64_C(0xcbf29ce484222325);
+	}
+	for (size_t i = 0; i < size; i++) {
+		stamp ^= bytes[i];
+		stamp *= UINT64_C(0x100000001b3);
+	}
+	return stamp;
+}
@@ -0,0 +1,70 @@
+#ifndef STATE_FILE_H
+#define STATE_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Derived state that's needed at startup, e.g. the cached list of desktop
+ * apps, is kept in sections of a single file, $XDG_CACHE_HOME/tofi-state.
+ * That way, a warm start only has to open and mmap() one file, and then
+ * only touches the pages of the sections it actually uses.
+ *
+ * Each section has a stamp saying what it was generated from, e.g. a hash of
+ * the modification times of the directories desktop files are read from. A
+ * section whose stamp doesn't match is treated as missing.
+ *
+ * The layout is:
+ *
+ *   "tofi-st1"
+ *   u32 number of sections
+ *   u32 padding
+ *   struct { u32 id; u32 padding; u64 stamp; u64 offset; u64 size; }[]
+ *   section data[], each 8-byte aligned
+ *
+ * with integers in native byte order, as the file never leaves the machine.
+ */
+#define STATE_FILE_MAX_SECTIONS 16
+
+enum state_section {
+	STATE_SECTION_RUN_VIEW = 1,
+	STATE_SECTION_DRUN_VIEW,
+	STATE_SECTION_DRUN_APPS
+};
+
+/*
+ * Return the contents of section id if it's there and its stamp matches,
+ * setting size, or NULL if not. The contents point into the mapped file, and
+ * stay valid for as long as tofi runs, even if the section is replaced.
+ */
+const char *state_file_get(enum state_section id, uint64_t stamp, size_t *size);
+
+/*
+ * Return section id whatever its stamp, e.g. to carry on with a stale copy
+ * while someone else regenerates it.
+ */
+const char *state_file_get_stale(enum state_section id, size_t *size);
+
+/*
+ * Map the file again, to pick up changes made by other processes. Sections
+ * returned before this stay valid.
+ */
+void state_file_reload(void);
+
+/*
+ * Take a lock for regenerating section id, as with cache_lock(), so that
+ * only one process does so at once. Release it with cache_unlock().
+ */
+int state_file_lock_section(enum state_section id, bool wait);
+
+/*
+ * Replace section id in the file on disk. Errors are logged, but otherwise
+ * ignored, as the worst that can happen is a slower start next time.
+ */
+void state_file_set(enum state_section id, uint64_t stamp, const void *data, size_t size);
+
+/* Mix some data into a stamp, starting from 0. */
+uint64_t state_file_stamp(uint64_t stamp, const void *data, size_t size);
+
+#endif /* STATE_FILE_H */
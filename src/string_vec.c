@@ -7,6 +7,8 @@
 #include <sys/mman.h>
 #include "fuzzy_match.h"
 #include "history.h"
+#include "parallel.h"
+#include "query.h"
 #include "string_vec.h"
 #include "unicode.h"
 #include "xmalloc.h"
@@ -91,6 +93,8 @@ struct string_ref_vec string_ref_vec_copy(const struct string_ref_vec *restrict
 		copy.buf[i].string = vec->buf[i].string;
 		copy.buf[i].search_score = vec->buf[i].search_score;
 		copy.buf[i].history_score = vec->buf[i].history_score;
+		copy.buf[i].basename = vec->buf[i].basename;
+		copy.buf[i].info = vec->buf[i].info;
 	}
 
 	return copy;
@@ -114,7 +118,7 @@ void string_vec_add(struct string_vec *restrict vec, const char *restrict str)
 	vec->count++;
 }
 
-void string_ref_vec_add(struct string_ref_vec *restrict vec, char *restrict str)
+void string_ref_vec_add(struct string_ref_vec *restrict vec, const char *restrict str)
 {
 	if (vec->count == vec->size) {
 		vec->size *= 2;
@@ -123,6 +127,8 @@ void string_ref_vec_add(struct string_ref_vec *restrict vec, char *restrict str)
 	vec->buf[vec->count].string = str;
 	vec->buf[vec->count].search_score = 0;
 	vec->buf[vec->count].history_score = 0;
+	vec->buf[vec->count].basename = 0;
+	vec->buf[vec->count].info = (struct match_info){0};
 	vec->count++;
 }
 
@@ -140,7 +146,7 @@ void string_ref_vec_history_sort(struct string_ref_vec *restrict vec, struct his
 	 */
 	GHashTable *hash = g_hash_table_new(g_str_hash, g_str_equal);
 	for (size_t i = 0; i < vec->count; i++) {
-		g_hash_table_insert(hash, vec->buf[i].string, &vec->buf[i]);
+		g_hash_table_insert(hash, (gpointer)vec->buf[i].string, &vec->buf[i]);
 	}
 	for (size_t i = 0; i < history->count; i++) {
 		struct scored_string_ref *res = g_hash_table_lookup(hash, history->buf[i].name);
@@ -180,40 +186,128 @@ struct scored_string_ref *string_ref_vec_find_sorted(struct string_ref_vec *rest
 
 struct string_ref_vec string_ref_vec_filter(
 		const struct string_ref_vec *restrict vec,
-		const char *restrict substr,
-		bool fuzzy)
+		const struct query *restrict query)
 {
-	if (substr[0] == '\0') {
+	if (query->num_groups == 0) {
 		return string_ref_vec_copy(vec);
 	}
 	struct string_ref_vec filt = string_ref_vec_create();
-	for (size_t i = 0; i < vec->count; i++) {
-		int32_t search_score;
-		if (fuzzy) {
-			search_score = fuzzy_match_words(substr, vec->buf[i].string);
-		} else {
-			search_score = fuzzy_match_simple_words(substr, vec->buf[i].string);
-		}
+	string_ref_vec_filter_range(vec, 0, vec->count, query, &filt);
+	string_ref_vec_sort_by_score(&filt);
+	return filt;
+}
+
+void string_ref_vec_filter_range(
+		const struct string_ref_vec *restrict vec,
+		size_t start,
+		size_t end,
+		const struct query *restrict query,
+		struct string_ref_vec *restrict filt)
+{
+	for (size_t i = start; i < end; i++) {
+		int32_t search_score = query_match(
+				query,
+				vec->buf[i].string,
+				vec->buf[i].basename,
+				&vec->buf[i].info);
 		if (search_score != INT32_MIN) {
-			string_ref_vec_add(&filt, vec->buf[i].string);
-			filt.buf[filt.count - 1].search_score = search_score;
-			filt.buf[filt.count - 1].history_score = vec->buf[i].history_score;
+			string_ref_vec_add(filt, vec->buf[i].string);
+			filt->buf[filt->count - 1].search_score = search_score;
+			filt->buf[filt->count - 1].history_score = vec->buf[i].history_score;
+			filt->buf[filt->count - 1].basename = vec->buf[i].basename;
+			filt->buf[filt->count - 1].info = vec->buf[i].info;
 		}
 	}
+}
+
+void string_ref_vec_sort_by_score(struct string_ref_vec *restrict vec)
+{
 	/* Sort the results by their search score. */
-	qsort(filt.buf, filt.count, sizeof(filt.buf[0]), cmpscorep);
-	return filt;
+	qsort(vec->buf, vec->count, sizeof(vec->buf[0]), cmpscorep);
+}
+
+struct line_chunk {
+	struct chunk chunk;
+	struct string_ref_vec vec;
+};
+
+/*
+ * Split one chunk of a buffer into lines, in place. Empty lines are skipped,
+ * as strtok_r() would.
+ */
+static int split_line_chunk(void *arg)
+{
+	struct line_chunk *lc = arg;
+	char *line = lc->chunk.start;
+	char *end = line + lc->chunk.length;
+
+	lc->vec = string_ref_vec_create();
+	while (line < end) {
+		char *newline = memchr(line, '\n', end - line);
+		if (newline == NULL) {
+			newline = end;
+		}
+		if (newline > line) {
+			*newline = '\0';
+			string_ref_vec_add(&lc->vec, line);
+			/*
+			 * Find the basename now, rather than every time we
+			 * search, in case path-match is enabled.
+			 */
+			lc->vec.buf[lc->vec.count - 1].basename = path_basename_offset(line);
+		}
+		line = newline + 1;
+	}
+	return 0;
 }
 
 struct string_ref_vec string_ref_vec_from_buffer(char *buffer)
 {
-	struct string_ref_vec vec = string_ref_vec_create();
+	/*
+	 * For huge inputs, split the buffer up and scan each piece on its
+	 * own thread, then stitch the results together. The strings
+	 * themselves stay where they are in the buffer, so only the
+	 * references need copying.
+	 */
+	struct chunk chunks[MAX_CHUNKS];
+	struct line_chunk line_chunks[MAX_CHUNKS];
+	size_t num_chunks = split_lines(buffer, strlen(buffer), chunks);
+	for (size_t i = 0; i < num_chunks; i++) {
+		line_chunks[i].chunk = chunks[i];
+	}
+	run_parallel(split_line_chunk, line_chunks, sizeof(line_chunks[0]), num_chunks);
+
+	if (num_chunks == 1) {
+		return line_chunks[0].vec;
+	}
 
-	char *saveptr = NULL;
-	char *line = strtok_r(buffer, "\n", &saveptr);
-	while (line != NULL) {
-		string_ref_vec_add(&vec, line);
-		line = strtok_r(NULL, "\n", &saveptr);
+	size_t count = 0;
+	for (size_t i = 0; i < num_chunks; i++) {
+		count += line_chunks[i].vec.count;
+	}
+	struct string_ref_vec vec = {
+		.count = count,
+		.size = count > 0 ? count : 1,
+	};
+	vec.buf = xcalloc(vec.size, sizeof(*vec.buf));
+	size_t n = 0;
+	for (size_t i = 0; i < num_chunks; i++) {
+		struct string_ref_vec *v = &line_chunks[i].vec;
+		memcpy(&vec.buf[n], v->buf, v->count * sizeof(*v->buf));
+		n += v->count;
+		string_ref_vec_destroy(v);
 	}
 	return vec;
 }
+
+/*
+ * Work out everything fuzzy matching needs to know about each string up front,
+ * rather than on every keystroke. This isn't done by default, as it's a waste
+ * of time for simple substring matching.
+ */
+void string_ref_vec_init_match_info(struct string_ref_vec *restrict vec)
+{
+	for (size_t i = 0; i < vec->count; i++) {
+		match_info_init(&vec->buf[i].info, vec->buf[i].string);
+	}
+}
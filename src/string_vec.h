@@ -5,7 +5,9 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "fuzzy_match.h"
 #include "history.h"
+#include "query.h"
 
 struct scored_string {
 	char *string;
@@ -35,11 +37,20 @@ struct scored_string *string_vec_find_sorted(struct string_vec *restrict vec, co
  * Like a string_vec, but only store a reference to the corresponding string
  * rather than copying it. Although compatible with the string_vec struct, we
  * create a new struct to make the compiler complain if we mix them up.
+ *
+ * basename is the offset of the last path component in string, for
+ * path-match mode. It's only found for lines read in by
+ * string_ref_vec_from_buffer(), and is 0 otherwise.
+ *
+ * info is only filled in by string_ref_vec_init_match_info(), and is
+ * otherwise zeroed.
  */
 struct scored_string_ref {
-	char *string;
+	const char *string;
 	int32_t search_score;
 	int32_t history_score;
+	uint32_t basename;
+	struct match_info info;
 };
 
 struct string_ref_vec {
@@ -61,7 +72,7 @@ void string_ref_vec_destroy(struct string_ref_vec *restrict vec);
 [[nodiscard("memory leaked")]]
 struct string_ref_vec string_ref_vec_copy(const struct string_ref_vec *restrict vec);
 
-void string_ref_vec_add(struct string_ref_vec *restrict vec, char *restrict str);
+void string_ref_vec_add(struct string_ref_vec *restrict vec, const char *restrict str);
 
 void string_ref_vec_history_sort(struct string_ref_vec *restrict vec, struct history *history);
 
@@ -72,10 +83,25 @@ struct scored_string_ref *string_ref_vec_find_sorted(struct string_ref_vec *rest
 [[nodiscard("memory leaked")]]
 struct string_ref_vec string_ref_vec_filter(
 		const struct string_ref_vec *restrict vec,
-		const char *restrict substr,
-		bool fuzzy);
+		const struct query *restrict query);
+
+/*
+ * Filter the elements [start, end) of vec, appending any matches to filt.
+ * This allows filtering to be split up into chunks. Once all chunks are done,
+ * filt should be sorted with string_ref_vec_sort_by_score().
+ */
+void string_ref_vec_filter_range(
+		const struct string_ref_vec *restrict vec,
+		size_t start,
+		size_t end,
+		const struct query *restrict query,
+		struct string_ref_vec *restrict filt);
+
+void string_ref_vec_sort_by_score(struct string_ref_vec *restrict vec);
 
 [[nodiscard("memory leaked")]]
 struct string_ref_vec string_ref_vec_from_buffer(char *buffer);
 
+void string_ref_vec_init_match_info(struct string_ref_vec *restrict vec);
+
 #endif /* STRING_VEC_H */
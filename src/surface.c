@@ -76,10 +76,23 @@ void surface_destroy(struct surface *surface)
 	wl_buffer_destroy(surface->buffers[1]);
 }
 
-void surface_draw(struct surface *surface)
+/*
+ * Show the next buffer. If image is given, only its damaged region is marked
+ * as having changed since the last buffer, otherwise the whole thing is.
+ */
+void surface_draw(struct surface *surface, const struct image *image)
 {
 	wl_surface_attach(surface->wl_surface, surface->buffers[surface->index], 0, 0);
-	wl_surface_damage_buffer(surface->wl_surface, 0, 0, INT32_MAX, INT32_MAX);
+	if (image == NULL) {
+		wl_surface_damage_buffer(surface->wl_surface, 0, 0, INT32_MAX, INT32_MAX);
+	} else {
+		wl_surface_damage_buffer(
+				surface->wl_surface,
+				image->damage.x,
+				image->damage.y,
+				image->damage.width,
+				image->damage.height);
+	}
 	wl_surface_commit(surface->wl_surface);
 
 	surface->index = !surface->index;
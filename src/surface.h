@@ -26,6 +26,6 @@ void surface_init(
 		struct surface *surface,
 		struct wl_shm *wl_shm);
 void surface_destroy(struct surface *surface);
-void surface_draw(struct surface *surface);
+void surface_draw(struct surface *surface, const struct image *image);
 
 #endif /* SURFACE_H */
@@ -8,7 +8,12 @@
 #include "clipboard.h"
 #include "color.h"
 #include "entry.h"
+#include "filter_thread.h"
+#include "group_cache.h"
 #include "image.h"
+#include "prewarm.h"
+#include "recorder.h"
+#include "speculate.h"
 #include "surface.h"
 #include "wlr-layer-shell-unstable-v1.h"
 
@@ -16,6 +21,8 @@
 #define MAX_TERMINAL_NAME_LEN 256
 #define MAX_HISTORY_FILE_NAME_LEN 256
 
+struct candidate_loader;
+
 struct output_list_element {
 	struct wl_list link;
 	struct wl_output *wl_output;
@@ -55,6 +62,16 @@ struct tofi {
 	int32_t output_width;
 	int32_t output_height;
 	struct clipboard clipboard;
+	struct speculator speculator;
+	struct filter_thread filter;
+	struct group_cache groups;
+	struct prewarm prewarm;
+	struct recorder recorder;
+	/*
+	 * Set while we're only showing the cached initial view, and the real
+	 * list of candidates hasn't been loaded yet.
+	 */
+	struct candidate_loader *deferred_loader;
 	struct {
 		struct surface surface;
 		struct zwlr_layer_surface_v1 *zwlr_layer_surface;
@@ -87,6 +104,7 @@ struct tofi {
 	/* Options */
 	uint32_t anchor;
 	bool ascii_input;
+	bool background_load;
 	bool hide_cursor;
 	bool use_history;
 	bool use_scale;
@@ -94,6 +112,8 @@ struct tofi {
 	bool drun_launch;
 	bool drun_print_exec;
 	bool fuzzy_match;
+	bool path_match;
+	bool sort_results;
 	bool require_match;
 	bool multiple_instance;
 	char target_output_name[MAX_OUTPUT_NAME_LEN];
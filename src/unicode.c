@@ -1,7 +1,10 @@
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "parallel.h"
 #include "unicode.h"
+#include "xmalloc.h"
 
 uint8_t utf32_to_utf8(uint32_t c, char *buf)
 {
@@ -121,3 +124,98 @@ bool utf8_validate(const char *s)
 {
 	return g_utf8_validate(s, -1, NULL);
 }
+
+struct normalize_chunk {
+	struct chunk chunk;
+	/* NULL if normalizing didn't change anything. */
+	char *normalized;
+	size_t length;
+	bool valid;
+};
+
+/* Check a word at a time for any bytes with the top bit set. */
+static bool is_ascii(const char *s, size_t length)
+{
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, &s[i], sizeof(word));
+		if (word & 0x8080808080808080u) {
+			return false;
+		}
+	}
+	for (; i < length; i++) {
+		if (s[i] & 0x80) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int normalize_chunk(void *arg)
+{
+	struct normalize_chunk *nc = arg;
+	nc->normalized = NULL;
+	nc->length = nc->chunk.length;
+
+	/* Plain ASCII is always valid, and unchanged by normalization. */
+	if (is_ascii(nc->chunk.start, nc->chunk.length)) {
+		nc->valid = true;
+		return 0;
+	}
+	nc->valid = g_utf8_validate(nc->chunk.start, nc->chunk.length, NULL);
+	if (nc->valid) {
+		nc->normalized = g_utf8_normalize(
+				nc->chunk.start,
+				nc->chunk.length,
+				G_NORMALIZE_DEFAULT);
+		nc->length = strlen(nc->normalized);
+	}
+	return 0;
+}
+
+/*
+ * Validate and normalize a buffer of newline-separated lines, splitting the
+ * work across cores for big buffers. Normalization never combines characters
+ * across a newline, so each chunk can be handled on its own.
+ *
+ * If anything changes, *buffer is freed and replaced. If the buffer isn't
+ * valid UTF-8, false is returned and *buffer is left alone.
+ */
+bool utf8_normalize_lines(char **buffer, size_t length)
+{
+	struct chunk chunks[MAX_CHUNKS];
+	struct normalize_chunk normalize_chunks[MAX_CHUNKS];
+	size_t num_chunks = split_lines(*buffer, length, chunks);
+	for (size_t i = 0; i < num_chunks; i++) {
+		normalize_chunks[i].chunk = chunks[i];
+	}
+	run_parallel(normalize_chunk, normalize_chunks, sizeof(normalize_chunks[0]), num_chunks);
+
+	bool valid = true;
+	bool changed = false;
+	size_t total = 0;
+	for (size_t i = 0; i < num_chunks; i++) {
+		valid = valid && normalize_chunks[i].valid;
+		changed = changed || normalize_chunks[i].normalized != NULL;
+		total += normalize_chunks[i].length;
+	}
+
+	if (valid && changed) {
+		char *buf = xmalloc(total + 1);
+		size_t written = 0;
+		for (size_t i = 0; i < num_chunks; i++) {
+			struct normalize_chunk *nc = &normalize_chunks[i];
+			const char *src = nc->normalized ? nc->normalized : nc->chunk.start;
+			memcpy(&buf[written], src, nc->length);
+			written += nc->length;
+		}
+		buf[written] = '\0';
+		free(*buffer);
+		*buffer = buf;
+	}
+	for (size_t i = 0; i < num_chunks; i++) {
+		free(normalize_chunks[i].normalized);
+	}
+	return valid;
+}
@@ -26,5 +26,6 @@ char *utf8_strcasestr(const char * restrict haystack, const char * restrict need
 char *utf8_normalize(const char *s);
 char *utf8_compose(const char *s);
 bool utf8_validate(const char *s);
+bool utf8_normalize_lines(char **buffer, size_t length);
 
 #endif /* UNICODE_H */
@@ -0,0 +1,91 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compgen.h"
+#include "drun.h"
+#include "log.h"
+#include "state_file.h"
+#include "string_vec.h"
+#include "view_cache.h"
+#include "xmalloc.h"
+
+#undef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* The view is only a handful of lines, so anything bigger is bogus. */
+#define MAX_VIEW_CACHE_SIZE (1024*1024)
+
+static enum state_section view_section(bool drun)
+{
+	return drun ? STATE_SECTION_DRUN_VIEW : STATE_SECTION_RUN_VIEW;
+}
+
+/*
+ * The view is only valid for the apps or programs it was made from, so it's
+ * stamped the same way as their caches.
+ */
+static uint64_t view_stamp(bool drun)
+{
+	return drun ? drun_stamp() : compgen_stamp();
+}
+
+/*
+ * Read the cached initial view, returning a newline-separated buffer suitable
+ * for string_ref_vec_from_buffer(), or NULL if there isn't one or it's out of
+ * date. A missing cache is normal (e.g. on first run), so isn't an error.
+ */
+char *view_cache_load(bool drun)
+{
+	size_t len;
+	const char *view = state_file_get(view_section(drun), view_stamp(drun), &len);
+	if (view == NULL || len == 0 || len > MAX_VIEW_CACHE_SIZE) {
+		return NULL;
+	}
+
+	char *buf = xmalloc(len + 1);
+	memcpy(buf, view, len);
+	buf[len] = '\0';
+	return buf;
+}
+
+/*
+ * Save the first VIEW_CACHE_SIZE entries of view. Errors are logged, but
+ * otherwise ignored, as the worst that can happen is a slower start next time.
+ */
+void view_cache_save(const struct string_ref_vec *view, bool drun)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	errno = 0;
+	FILE *fp = open_memstream(&buf, &len);
+	if (fp == NULL) {
+		log_error("Failed to save view cache: %s\n", strerror(errno));
+		return;
+	}
+	size_t count = MIN(view->count, VIEW_CACHE_SIZE);
+	for (size_t i = 0; i < count; i++) {
+		fprintf(fp, "%s\n", view->buf[i].string);
+	}
+	fclose(fp);
+	state_file_set(view_section(drun), view_stamp(drun), buf, len);
+	free(buf);
+}
+
+/*
+ * Check whether view (as loaded from the cache) is still the start of
+ * results, so we can avoid rewriting it needlessly.
+ */
+bool view_cache_matches(const struct string_ref_vec *view, const struct string_ref_vec *results)
+{
+	size_t count = MIN(results->count, VIEW_CACHE_SIZE);
+	if (view->count != count) {
+		return false;
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (strcmp(view->buf[i].string, results->buf[i].string)) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,22 @@
+#ifndef VIEW_CACHE_H
+#define VIEW_CACHE_H
+
+#include <stdbool.h>
+#include "string_vec.h"
+
+/*
+ * The initial view is the first few results tofi-run or tofi-drun show for an
+ * empty query, with history taken into account. It's cached separately from
+ * the full list of candidates, so that the first frame can be drawn without
+ * loading and ranking everything.
+ */
+#define VIEW_CACHE_SIZE 128
+
+[[nodiscard("memory leaked")]]
+char *view_cache_load(bool drun);
+
+void view_cache_save(const struct string_ref_vec *view, bool drun);
+
+bool view_cache_matches(const struct string_ref_vec *view, const struct string_ref_vec *results);
+
+#endif /* VIEW_CACHE_H */
@@ -0,0 +1,262 @@
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "entry.h"
+#include "fuzzy_match.h"
+#include "perf.h"
+#include "query.h"
+#include "string_vec.h"
+#include "xmalloc.h"
+
+/*
+ * Benchmarks for the hot paths: matching, filtering and drawing.
+ *
+ * Each case is run until it's taken at least MIN_BENCH_TIME, and the mean
+ * time per iteration is reported, along with hardware counters where the
+ * kernel lets us read them. Counters only cover the main thread, so they
+ * miss any work done by the harfbuzz backend's render threads.
+ *
+ * Usage: bench [font]
+ *
+ * The font is passed straight on to the entry, so a path to a font file
+ * benchmarks the harfbuzz backend, and anything else benchmarks Pango.
+ */
+
+#define SECOND 1000000000ul
+#define MIN_BENCH_TIME (SECOND / 4)
+#define MIN_ITERATIONS 10
+
+#define NUM_CANDIDATES 20000
+
+#define WINDOW_WIDTH 1280
+#define WINDOW_HEIGHT 720
+
+static struct perf_counters perf;
+
+static void bench(const char *name, void (*fn)(void *), void *arg)
+{
+	/* Warm up the caches (and any lazy initialisation). */
+	fn(arg);
+
+	struct timespec start;
+	struct timespec now;
+	uint64_t elapsed;
+	size_t iterations = 0;
+
+	perf_counters_start(&perf);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		fn(arg);
+		iterations++;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (now.tv_sec - start.tv_sec) * SECOND + now.tv_nsec - start.tv_nsec;
+	} while (elapsed < MIN_BENCH_TIME || iterations < MIN_ITERATIONS);
+	perf_counters_stop(&perf);
+
+	printf("%-28s %8zu %12.1f", name, iterations, (double)elapsed / iterations / 1000.0);
+	for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+		if (perf_counter_available(&perf, i)) {
+			printf(" %14.0f", (double)perf.value[i] / iterations);
+		} else {
+			printf(" %14s", "-");
+		}
+	}
+	if (perf_counter_available(&perf, PERF_CYCLES)
+			&& perf_counter_available(&perf, PERF_INSTRUCTIONS)
+			&& perf.value[PERF_CYCLES] > 0) {
+		printf(" %6.2f", (double)perf.value[PERF_INSTRUCTIONS] / perf.value[PERF_CYCLES]);
+	} else {
+		printf(" %6s", "-");
+	}
+	printf("\n");
+}
+
+/*
+ * Make up some plausible looking command names, e.g. "kalo-venitra". The
+ * generator is seeded with a constant, so every run sees the same list.
+ */
+static char *make_candidates(size_t count)
+{
+	static const char *syllables[] = {
+		"ka", "lo", "ve", "ni", "tra", "sh", "co", "de", "xi", "mu",
+		"pe", "ro", "gi", "ta", "fo", "wu", "ly", "zen", "qu", "bar"
+	};
+	const size_t num_syllables = sizeof(syllables) / sizeof(syllables[0]);
+	uint32_t state = 0x12345678;
+
+	size_t size = count * 48;
+	char *buffer = xmalloc(size);
+	size_t len = 0;
+	for (size_t i = 0; i < count; i++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		size_t words = 1 + state % 3;
+		for (size_t w = 0; w < words; w++) {
+			if (w > 0) {
+				buffer[len++] = '-';
+			}
+			size_t n = 2 + (state >> (8 * w)) % 3;
+			for (size_t s = 0; s < n; s++) {
+				const char *syl = syllables[(state >> (2 * s + 5 * w)) % num_syllables];
+				size_t syl_len = strlen(syl);
+				memcpy(&buffer[len], syl, syl_len);
+				len += syl_len;
+			}
+		}
+		buffer[len++] = '\n';
+	}
+	buffer[len] = '\0';
+	return buffer;
+}
+
+struct fuzzy_case {
+	const struct string_ref_vec *candidates;
+	const char *pattern;
+};
+
+static void run_fuzzy_match(void *arg)
+{
+	struct fuzzy_case *c = arg;
+	/* Stop the compiler from throwing the results away. */
+	volatile int32_t sink = 0;
+	for (size_t i = 0; i < c->candidates->count; i++) {
+		sink += fuzzy_match(
+				c->pattern,
+				c->candidates->buf[i].string,
+				&c->candidates->buf[i].info);
+	}
+	(void)sink;
+}
+
+struct filter_case {
+	const struct string_ref_vec *candidates;
+	struct query query;
+};
+
+static void run_filter(void *arg)
+{
+	struct filter_case *c = arg;
+	struct string_ref_vec results = string_ref_vec_filter(c->candidates, &c->query);
+	string_ref_vec_destroy(&results);
+}
+
+static void bench_filter(
+		const char *name,
+		const struct string_ref_vec *candidates,
+		const char *input,
+		bool fuzzy)
+{
+	struct filter_case c = {
+		.candidates = candidates,
+		.query = query_compile(input, fuzzy, false)
+	};
+	bench(name, run_filter, &c);
+	query_destroy(&c.query);
+}
+
+static void run_entry_update(void *arg)
+{
+	/* Draw every frame from scratch, rather than from the last one. */
+	struct entry *entry = arg;
+	entry->harfbuzz.last_frame.valid = false;
+	entry_update(entry);
+}
+
+static void run_entry_scroll(void *arg)
+{
+	/* Scroll back and forth by a row, so each frame can reuse the last. */
+	struct entry *entry = arg;
+	entry->first_result = !entry->first_result;
+	entry_update(entry);
+}
+
+static void bench_entry_update(const struct string_ref_vec *candidates, const char *font)
+{
+	/* The same defaults as tofi itself. */
+	static struct entry entry = {
+		.font_size = 24,
+		.prompt_text = "run: ",
+		.padding_top = 8,
+		.padding_bottom = 8,
+		.padding_left = 8,
+		.padding_right = 8,
+		.clip_to_padding = true,
+		.border_width = 12,
+		.outline_width = 4,
+		.background_color = {0.106f, 0.114f, 0.118f, 1.0f},
+		.foreground_color = {1.0f, 1.0f, 1.0f, 1.0f},
+		.border_color = {0.976f, 0.149f, 0.447f, 1.0f},
+		.outline_color = {0.031f, 0.031f, 0.0f, 1.0f},
+		.placeholder_theme.foreground_color = {1.0f, 1.0f, 1.0f, 0.66f},
+		.placeholder_theme.foreground_specified = true,
+		.selection_theme.foreground_color = {0.976f, 0.149f, 0.447f, 1.0f},
+		.selection_theme.foreground_specified = true
+	};
+	snprintf(entry.font_name, sizeof(entry.font_name), "%s", font);
+
+	uint8_t *buffer = xcalloc(2 * WINDOW_WIDTH * WINDOW_HEIGHT, sizeof(uint32_t));
+	entry_init(&entry, buffer, WINDOW_WIDTH, WINDOW_HEIGHT);
+	entry.results = string_ref_vec_copy(candidates);
+
+	bench("entry_update (no input)", run_entry_update, &entry);
+
+	entry.input_utf32[0] = U'c';
+	entry.input_utf32[1] = U'o';
+	entry.input_utf32_length = 2;
+	snprintf(entry.input_utf8, sizeof(entry.input_utf8), "co");
+	entry.input_utf8_length = 2;
+	struct query query = query_compile("co", false, false);
+	string_ref_vec_destroy(&entry.results);
+	entry.results = string_ref_vec_filter(candidates, &query);
+	query_destroy(&query);
+
+	bench("entry_update (\"co\")", run_entry_update, &entry);
+
+	entry.first_result = 0;
+	entry.selection = 0;
+	entry_update(&entry);
+	bench("entry_update (scroll)", run_entry_scroll, &entry);
+
+	string_ref_vec_destroy(&entry.results);
+	entry_destroy(&entry);
+	free(buffer);
+}
+
+int main(int argc, char *argv[])
+{
+	setlocale(LC_ALL, "");
+
+	const char *font = argc > 1 ? argv[1] : "Sans";
+
+	char *buffer = make_candidates(NUM_CANDIDATES);
+	struct string_ref_vec candidates = string_ref_vec_from_buffer(buffer);
+	string_ref_vec_init_match_info(&candidates);
+
+	perf_counters_open(&perf);
+
+	printf("%-28s %8s %12s %14s %14s %14s %14s %6s\n",
+			"case", "iters", "time (us)",
+			"cycles", "instructions", "cache misses", "branch misses",
+			"IPC");
+
+	struct fuzzy_case fuzzy = { .candidates = &candidates, .pattern = "co" };
+	bench("fuzzy_match \"co\"", run_fuzzy_match, &fuzzy);
+	fuzzy.pattern = "kavetra";
+	bench("fuzzy_match \"kavetra\"", run_fuzzy_match, &fuzzy);
+
+	bench_filter("filter \"co\"", &candidates, "co", false);
+	bench_filter("filter \"co\" (fuzzy)", &candidates, "co", true);
+	bench_filter("filter \"ka ve\" (fuzzy)", &candidates, "ka ve", true);
+	bench_filter("filter \"^ka !ve bar$\"", &candidates, "^ka !ve bar$", true);
+
+	bench_entry_update(&candidates, font);
+
+	perf_counters_close(&perf);
+	string_ref_vec_destroy(&candidates);
+	free(buffer);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "perf.h"
+
+static const struct {
+	uint64_t config;
+	const char *name;
+} counter_info[PERF_NUM_COUNTERS] = {
+	[PERF_CYCLES] = { PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+	[PERF_INSTRUCTIONS] = { PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+	[PERF_CACHE_MISSES] = { PERF_COUNT_HW_CACHE_MISSES, "cache misses" },
+	[PERF_BRANCH_MISSES] = { PERF_COUNT_HW_BRANCH_MISSES, "branch misses" },
+};
+
+/* What read() gives us with the read_format below. */
+struct perf_reading {
+	uint64_t value;
+	uint64_t time_enabled;
+	uint64_t time_running;
+};
+
+void perf_counters_open(struct perf_counters *perf)
+{
+	for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+		struct perf_event_attr attr = {
+			.type = PERF_TYPE_HARDWARE,
+			.size = sizeof(attr),
+			.config = counter_info[i].config,
+			.disabled = 1,
+			/* Unprivileged users can usually only count user space. */
+			.exclude_kernel = 1,
+			.exclude_hv = 1,
+			.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+				| PERF_FORMAT_TOTAL_TIME_RUNNING
+		};
+		perf->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		perf->value[i] = 0;
+		if (perf->fd[i] == -1) {
+			fprintf(stderr, "Couldn't open %s counter: %s\n",
+					counter_info[i].name,
+					strerror(errno));
+		}
+	}
+}
+
+void perf_counters_close(struct perf_counters *perf)
+{
+	for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+		if (perf->fd[i] != -1) {
+			close(perf->fd[i]);
+			perf->fd[i] = -1;
+		}
+	}
+}
+
+void perf_counters_start(struct perf_counters *perf)
+{
+	for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+		if (perf->fd[i] != -1) {
+			ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+void perf_counters_stop(struct perf_counters *perf)
+{
+	for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+		if (perf->fd[i] != -1) {
+			ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+	for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+		perf->value[i] = 0;
+		if (perf->fd[i] == -1) {
+			continue;
+		}
+		struct perf_reading reading;
+		if (read(perf->fd[i], &reading, sizeof(reading)) != sizeof(reading)) {
+			continue;
+		}
+		/*
+		 * If there are more counters than the hardware can track at
+		 * once, the kernel multiplexes them, so scale up to estimate
+		 * the full count.
+		 */
+		if (reading.time_running > 0 && reading.time_running < reading.time_enabled) {
+			reading.value = (double)reading.value
+				* reading.time_enabled
+				/ reading.time_running;
+		}
+		perf->value[i] = reading.value;
+	}
+}
+
+bool perf_counter_available(const struct perf_counters *perf, enum perf_counter counter)
+{
+	return perf->fd[counter] != -1;
+}
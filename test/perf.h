@@ -0,0 +1,34 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum perf_counter {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_NUM_COUNTERS
+};
+
+/*
+ * Hardware performance counters for the calling thread, via perf_event_open.
+ *
+ * Each counter is opened separately, as virtual machines and some CPUs only
+ * support a few of them. Any that can't be opened (e.g. because
+ * perf_event_paranoid forbids it) are just left out, with a file descriptor
+ * of -1.
+ */
+struct perf_counters {
+	int fd[PERF_NUM_COUNTERS];
+	uint64_t value[PERF_NUM_COUNTERS];
+};
+
+void perf_counters_open(struct perf_counters *perf);
+void perf_counters_close(struct perf_counters *perf);
+void perf_counters_start(struct perf_counters *perf);
+void perf_counters_stop(struct perf_counters *perf);
+bool perf_counter_available(const struct perf_counters *perf, enum perf_counter counter);
+
+#endif /* PERF_H */
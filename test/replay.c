@@ -0,0 +1,368 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "compgen.h"
+#include "drun.h"
+#include "entry.h"
+#include "history.h"
+#include "input.h"
+#include "query.h"
+#include "recorder.h"
+#include "speculate.h"
+#include "string_vec.h"
+#include "tofi.h"
+#include "xmalloc.h"
+
+/*
+ * Replay a session recorded with TOFI_RECORD, timing how long each event
+ * takes to handle and draw.
+ *
+ * Usage: replay [--fast] [--font font] recording [candidates]
+ *
+ * Events are replayed with their original timing, so that speculative
+ * filtering gets the same idle time between keystrokes as it did live, unless
+ * --fast is given, in which case they're replayed back to back.
+ *
+ * Candidates are loaded the same way as tofi-run or tofi-drun would, with
+ * the default history file, or read from the given file for stdin
+ * recordings. If they don't match the ones recorded, the replay still goes
+ * ahead, but the timings won't be comparable.
+ *
+ * Drawing happens in an offscreen buffer, so no compositor is needed.
+ */
+
+#define SECOND 1000000000ul
+
+#define WINDOW_WIDTH 1280
+#define WINDOW_HEIGHT 720
+
+#define MAX_LINE_LENGTH (16 * MAX_INPUT_LENGTH)
+
+static struct tofi tofi = {
+	.window.entry = {
+		.font_size = 24,
+		.prompt_text = "run: ",
+		.padding_top = 8,
+		.padding_bottom = 8,
+		.padding_left = 8,
+		.padding_right = 8,
+		.clip_to_padding = true,
+		.border_width = 12,
+		.outline_width = 4,
+		.background_color = {0.106f, 0.114f, 0.118f, 1.0f},
+		.foreground_color = {1.0f, 1.0f, 1.0f, 1.0f},
+		.border_color = {0.976f, 0.149f, 0.447f, 1.0f},
+		.outline_color = {0.031f, 0.031f, 0.0f, 1.0f},
+		.placeholder_theme.foreground_color = {1.0f, 1.0f, 1.0f, 0.66f},
+		.placeholder_theme.foreground_specified = true,
+		.selection_theme.foreground_color = {0.976f, 0.149f, 0.447f, 1.0f},
+		.selection_theme.foreground_specified = true
+	},
+	.use_history = true
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * SECOND + t.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static char *read_file(const char *filename)
+{
+	errno = 0;
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "Couldn't open \"%s\": %s\n", filename, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	size_t size = 0;
+	size_t len = 0;
+	char *buffer = NULL;
+	do {
+		size = size ? 2 * size : 4096;
+		buffer = xrealloc(buffer, size + 1);
+		len += fread(&buffer[len], 1, size - len, fp);
+	} while (len == size);
+	buffer[len] = '\0';
+	fclose(fp);
+	return buffer;
+}
+
+/* Load the candidates the same way as main.c's load_candidates(). */
+static void load_candidates(const char *mode, const char *candidates_file)
+{
+	struct entry *entry = &tofi.window.entry;
+
+	if (!strcmp(mode, "run")) {
+		entry->command_buffer = compgen_cached();
+		struct string_ref_vec commands = string_ref_vec_from_buffer(entry->command_buffer);
+		if (tofi.fuzzy_match) {
+			string_ref_vec_init_match_info(&commands);
+		}
+		entry->history = history_load_default_file(false);
+		entry->commands = compgen_history_sort(&commands, &entry->history);
+		string_ref_vec_destroy(&commands);
+	} else if (!strcmp(mode, "drun")) {
+		entry->drun = true;
+		entry->apps = drun_generate_cached();
+		entry->history = history_load_default_file(true);
+		drun_history_sort(&entry->apps, &entry->history);
+		entry->commands = string_ref_vec_create();
+		for (size_t i = 0; i < entry->apps.count; i++) {
+			string_ref_vec_add(&entry->commands, entry->apps.buf[i].name);
+			entry->commands.buf[i].history_score = entry->apps.buf[i].history_score;
+		}
+	} else {
+		if (candidates_file == NULL) {
+			fprintf(stderr, "This is a recording of stdin, so needs a candidates file.\n");
+			exit(EXIT_FAILURE);
+		}
+		tofi.use_history = false;
+		entry->command_buffer = read_file(candidates_file);
+		entry->commands = string_ref_vec_from_buffer(entry->command_buffer);
+		if (tofi.fuzzy_match) {
+			string_ref_vec_init_match_info(&entry->commands);
+		}
+	}
+}
+
+/*
+ * Parse an event line into event, or for pasted text, into text. Returns the
+ * time the event was recorded at, or -1 if the line isn't a valid event.
+ */
+static int64_t parse_event(
+		char *line,
+		struct input_event *event,
+		uint32_t *text,
+		size_t *text_length)
+{
+	char *saveptr = NULL;
+	char *time = strtok_r(line, " \n", &saveptr);
+	char *name = strtok_r(NULL, " \n", &saveptr);
+	if (time == NULL || name == NULL) {
+		return -1;
+	}
+
+	bool is_text = !strcmp(name, "text");
+	if (!is_text && !recorder_parse_event(name, event)) {
+		return -1;
+	}
+
+	*text_length = 0;
+	char *arg;
+	while ((arg = strtok_r(NULL, " \n", &saveptr)) != NULL) {
+		uint32_t ch = strtoul(arg, NULL, 16);
+		if (!is_text) {
+			event->character = ch;
+		} else if (*text_length < MAX_INPUT_LENGTH) {
+			text[(*text_length)++] = ch;
+		}
+	}
+	if (is_text && *text_length == 0) {
+		return -1;
+	}
+	return strtoll(time, NULL, 10);
+}
+
+/* Add pasted text to the input, as main.c's read_clipboard() does. */
+static void add_text(const uint32_t *text, size_t length)
+{
+	input_insert_text(&tofi, text, length);
+}
+
+/*
+ * Wait until the event's original time, doing speculative filtering while
+ * we're idle, as tofi's main loop does.
+ */
+static void wait_until(uint64_t deadline)
+{
+	while (now_ns() < deadline) {
+		if (speculate_pending(&tofi)) {
+			speculate_step(&tofi);
+			continue;
+		}
+		uint64_t wait = deadline - now_ns();
+		if ((int64_t)wait <= 0) {
+			break;
+		}
+		struct timespec t = {
+			.tv_sec = wait / SECOND,
+			.tv_nsec = wait % SECOND
+		};
+		nanosleep(&t, NULL);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	setlocale(LC_ALL, "");
+
+	bool fast = false;
+	const char *font = "Sans";
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "--fast")) {
+			fast = true;
+		} else if (!strcmp(argv[i], "--font") && i + 1 < argc) {
+			font = argv[++i];
+		} else {
+			break;
+		}
+	}
+	if (i >= argc) {
+		fprintf(stderr, "Usage: %s [--fast] [--font font] recording [candidates]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	const char *recording = argv[i];
+	const char *candidates_file = i + 1 < argc ? argv[i + 1] : NULL;
+
+	errno = 0;
+	FILE *fp = fopen(recording, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "Couldn't open \"%s\": %s\n", recording, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	char line[MAX_LINE_LENGTH];
+	if (fgets(line, sizeof(line), fp) == NULL || strcmp(line, "tofi-recording 1\n")) {
+		fprintf(stderr, "\"%s\" isn't a tofi recording.\n", recording);
+		fclose(fp);
+		return EXIT_FAILURE;
+	}
+
+	char mode[8] = "stdin";
+	int fuzzy_match = 0;
+	int path_match = 0;
+	int sort_results = 1;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "mode %7s", mode) == 1) {
+			continue;
+		}
+		if (sscanf(line, "options %d %d %d", &fuzzy_match, &path_match, &sort_results) == 3) {
+			break;
+		}
+	}
+	tofi.fuzzy_match = fuzzy_match;
+	tofi.path_match = path_match;
+	tofi.sort_results = sort_results;
+
+	struct entry *entry = &tofi.window.entry;
+	snprintf(entry->font_name, sizeof(entry->font_name), "%s", font);
+	if (!strcmp(mode, "drun")) {
+		snprintf(entry->prompt_text, sizeof(entry->prompt_text), "drun: ");
+	}
+
+	load_candidates(mode, candidates_file);
+
+	uint8_t *buffer = xcalloc(2 * WINDOW_WIDTH * WINDOW_HEIGHT, sizeof(uint32_t));
+	entry_init(entry, buffer, WINDOW_WIDTH, WINDOW_HEIGHT);
+	input_refresh_results(&tofi);
+	speculate_reset(&tofi);
+	entry_update(entry);
+
+	size_t num_events = 0;
+	size_t events_size = 64;
+	uint64_t *latencies = xcalloc(events_size, sizeof(*latencies));
+
+	printf("%12s %-12s %10s %12s\n", "time (us)", "event", "results", "latency (us)");
+
+	uint64_t start = now_ns();
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		size_t count;
+		uint64_t fingerprint;
+		if (sscanf(line, "source %zu %" SCNx64, &count, &fingerprint) == 2) {
+			if (count != entry->commands.count
+					|| fingerprint != recorder_fingerprint(&entry->commands)) {
+				fprintf(stderr,
+					"Warning: recorded with %zu different candidates,"
+					" replaying with %zu.\n",
+					count,
+					entry->commands.count);
+			}
+			continue;
+		}
+
+		struct input_event event = { .action = INPUT_ACTION_NONE };
+		uint32_t text[MAX_INPUT_LENGTH];
+		size_t text_length = 0;
+		int64_t time = parse_event(line, &event, text, &text_length);
+		if (time < 0) {
+			continue;
+		}
+		/* The clipboard isn't recorded, only the text it gave us. */
+		if (event.action == INPUT_ACTION_PASTE) {
+			continue;
+		}
+
+		if (!fast) {
+			wait_until(start + time * 1000);
+		}
+
+		uint64_t t0 = now_ns();
+		if (text_length > 0) {
+			add_text(text, text_length);
+		} else {
+			input_apply(&tofi, event);
+		}
+		entry_update(entry);
+		uint64_t latency = now_ns() - t0;
+
+		if (num_events == events_size) {
+			events_size *= 2;
+			latencies = xrealloc(latencies, events_size * sizeof(*latencies));
+		}
+		latencies[num_events++] = latency;
+
+		const char *name = text_length > 0 ? "text" : recorder_event_name(&event);
+		printf("%12" PRId64 " %-12s %10zu %12.1f\n",
+				time, name, entry->results.count, latency / 1000.0);
+
+		if (tofi.closed || tofi.submit) {
+			break;
+		}
+	}
+	fclose(fp);
+
+	if (num_events > 0) {
+		uint64_t total = 0;
+		for (size_t n = 0; n < num_events; n++) {
+			total += latencies[n];
+		}
+		qsort(latencies, num_events, sizeof(*latencies), compare_u64);
+		printf("\n%zu events, latency (us): mean %.1f, p50 %.1f, p99 %.1f, max %.1f\n",
+				num_events,
+				(double)total / num_events / 1000.0,
+				latencies[num_events / 2] / 1000.0,
+				latencies[(num_events - 1) * 99 / 100] / 1000.0,
+				latencies[num_events - 1] / 1000.0);
+	}
+
+	free(latencies);
+	speculate_reset(&tofi);
+	string_ref_vec_destroy(&entry->results);
+	string_ref_vec_destroy(&entry->commands);
+	query_destroy(&entry->query);
+	if (entry->drun) {
+		desktop_vec_destroy(&entry->apps);
+	}
+	if (tofi.use_history) {
+		history_destroy(&entry->history);
+	}
+	free(entry->command_buffer);
+	entry_destroy(entry);
+	free(buffer);
+	return EXIT_SUCCESS;
+}
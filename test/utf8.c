@@ -3,7 +3,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "desktop_vec.h"
+#include "front_code.h"
 #include "fuzzy_match.h"
+#include "group_cache.h"
+#include "query.h"
 #include "tap.h"
 
 void is_simple_match(const char *pattern, const char *str, const char *message)
@@ -20,16 +24,126 @@ void isnt_simple_match(const char *pattern, const char *str, const char *message
 
 void is_fuzzy_match(const char *pattern, const char *str, const char *message)
 {
-	int32_t res = fuzzy_match_words(pattern, str);
+	int32_t res = fuzzy_match_words(pattern, str, NULL);
 	tap_isnt(res, INT32_MIN, message);
 }
 
 void isnt_fuzzy_match(const char *pattern, const char *str, const char *message)
 {
-	int32_t res = fuzzy_match_words(pattern, str);
+	int32_t res = fuzzy_match_words(pattern, str, NULL);
 	tap_is(res, INT32_MIN, message);
 }
 
+void is_same_fuzzy_score(const char *pattern, const char *str, const char *message)
+{
+	struct match_info info;
+	match_info_init(&info, str);
+	int32_t res = fuzzy_match_words(pattern, str, &info);
+	tap_is(res, fuzzy_match_words(pattern, str, NULL), message);
+}
+
+void is_query_match(const char *input, const char *str, const char *message)
+{
+	struct query query = query_compile(input, true, false);
+	tap_isnt(query_match(&query, str, 0, NULL), INT32_MIN, message);
+	query_destroy(&query);
+}
+
+void isnt_query_match(const char *input, const char *str, const char *message)
+{
+	struct query query = query_compile(input, true, false);
+	tap_is(query_match(&query, str, 0, NULL), INT32_MIN, message);
+	query_destroy(&query);
+}
+
+/*
+ * Filter a single app with the given name and keywords by input.
+ */
+void is_desktop_match(
+		const char *input,
+		const char *name,
+		const char *keywords,
+		bool expected,
+		const char *message)
+{
+	struct desktop_vec vec = desktop_vec_create();
+	desktop_vec_add(&vec, "app.desktop", name, "/app.desktop", keywords);
+	struct query query = query_compile(input, true, false);
+	struct string_ref_vec results = desktop_vec_filter(&vec, &query);
+	tap_is(results.count == 1, expected, message);
+	string_ref_vec_destroy(&results);
+	query_destroy(&query);
+	desktop_vec_destroy(&vec);
+}
+
+void is_front_code_prefix(const char *prefix, const char *expected, const char *message)
+{
+	char buffer[1024] = { 0 };
+	for (size_t i = 0; i < 40; i++) {
+		snprintf(&buffer[strlen(buffer)], 32, "x86_64-linux-gnu-%02zu\n", i);
+	}
+	strcat(buffer, "дξ-1\nдξ-2\n");
+
+	size_t size;
+	uint8_t *data = front_code_encode(buffer, &size);
+	struct front_code fc;
+	char match[FRONT_CODE_MAX_LENGTH];
+	bool found = front_code_open(&fc, data, size)
+		&& front_code_find_prefix(&fc, prefix, match);
+	if (expected == NULL) {
+		tap_is(found, false, message);
+	} else {
+		tap_is(found && !strcmp(match, expected), true, message);
+	}
+	free(data);
+}
+
+void is_front_code_round_trip(const char *buffer, const char *message)
+{
+	size_t size;
+	uint8_t *data = front_code_encode(buffer, &size);
+	struct front_code fc;
+	char *decoded = NULL;
+	if (front_code_open(&fc, data, size)) {
+		decoded = front_code_decode(&fc);
+	}
+	tap_is(decoded != NULL && !strcmp(decoded, buffer), true, message);
+	free(decoded);
+	free(data);
+}
+
+/*
+ * Filter some strings by first, then by second, which reuses first's cached
+ * word scores, and check the results are the same as for second alone.
+ */
+void is_same_cached_filter(const char *first, const char *second, const char *message)
+{
+	char buffer[] = "дξ-ab\nab-дξ\nabc\nдξ\nab\nx-ab-Дξ";
+	struct string_ref_vec vec = string_ref_vec_from_buffer(buffer);
+	struct group_cache cache = { 0 };
+
+	struct query query = query_compile(first, true, false);
+	struct string_ref_vec results = group_cache_filter(&cache, &vec, &query);
+	string_ref_vec_destroy(&results);
+	query_destroy(&query);
+
+	query = query_compile(second, true, false);
+	results = group_cache_filter(&cache, &vec, &query);
+	struct string_ref_vec expected = string_ref_vec_filter(&vec, &query);
+	bool same = results.count == expected.count;
+	for (size_t i = 0; same && i < results.count; i++) {
+		same = results.buf[i].string == expected.buf[i].string
+			&& results.buf[i].search_score == expected.buf[i].search_score;
+	}
+	tap_is(same, true, message);
+
+	string_ref_vec_destroy(&expected);
+	string_ref_vec_destroy(&results);
+	query_destroy(&query);
+	group_cache_reset(&cache);
+	string_ref_vec_destroy(&vec);
+}
+
 void is_match(const char *pattern, const char *str, const char *message)
 {
 	is_simple_match(pattern, str, message);
@@ -60,6 +174,44 @@ int main(int argc, char *argv[])
 	tap_todo("Needs composed character comparison");
 	isnt_fuzzy_match("ạ", "aọ", "Decomposed diacritics, character mismatch");
 
+	/* Precomputed match info. */
+	is_same_fuzzy_score("fm", "fuzzy_match", "Separator bonus from match info");
+	is_same_fuzzy_score("fm", "fuzzyMatch", "Camel case bonus from match info");
+	is_same_fuzzy_score("дé", "Ξдé-éξД", "Non-ASCII boundaries from match info");
+	is_same_fuzzy_score(
+			"az",
+			"a-very-long-string-that-carries-on-past-the-end-of-the-bitmaps-to-a-z",
+			"Boundaries past the end of match info");
+
+	/* Search operators. */
+	is_query_match("^Д", "дξ", "Prefix match, different case");
+	isnt_query_match("^ξ", "дξ", "Prefix match, wrong position");
+	is_query_match("Ξ$", "дξ", "Suffix match, different case");
+	is_query_match("^дΞ$", "Дξ", "Exact match, different case");
+	isnt_query_match("'дξ", "д-ξ", "Substring match isn't fuzzy");
+	isnt_query_match("!Д", "дξ", "Inverse match, different case");
+	is_query_match("ab | ξ", "дξ", "Alternative match");
+
+	/* App names and keywords. */
+	is_desktop_match("fire web", "Firefox", "Web;Browser;", true, "App match, name and keywords");
+	is_desktop_match("!fire", "Firefox", "Web;Browser;", false, "App match, inverse of name");
+	is_desktop_match("!web", "Firefox", "Web;Browser;", false, "App match, inverse of keyword");
+	is_desktop_match("!chrome web", "Firefox", "Web;Browser;", true, "App match, inverse of neither");
+
+	/* Cached word scores. */
+	is_same_cached_filter("ab дξ", "abc дξ", "Cached filter, first word edited");
+	is_same_cached_filter("ab !дξ", "ab | c !дξ", "Cached filter, operators");
+
+	/* Front coding. */
+	is_front_code_round_trip("", "Front coding, empty list");
+	is_front_code_round_trip(
+			"a\nab\nabc\nabd\nb\nba\nbad\nbadd\nc\nd\ndд\ndдξ\ndдξé\ne\nf\ng\ngg\nggg\nh\n",
+			"Front coding, more than one restart point");
+	is_front_code_prefix("x86_64-linux-gnu-3", "x86_64-linux-gnu-30", "Front coded prefix lookup");
+	is_front_code_prefix("x86_64-linux-gnu-16", "x86_64-linux-gnu-16", "Front coded lookup of restart point");
+	is_front_code_prefix("дξ", "дξ-1", "Front coded lookup, non-ASCII");
+	is_front_code_prefix("x86_64-linux-gnu-4", NULL, "Front coded lookup, no match");
+
 	tap_plan();
 
 	return EXIT_SUCCESS;